@@ -47,6 +47,7 @@
 #include "ags/resourceman.h"
 #include "ags/room.h"
 #include "ags/script.h"
+#include "ags/scriptprofiler.h"
 #include "ags/scripting/scripting.h"
 #include "ags/sprites.h"
 
@@ -139,7 +140,7 @@ AGSEngine::AGSEngine(OSystem *syst, const AGSGameDescription *gameDesc) :
 	_gameScript(NULL), _gameScriptFork(NULL), _dialogScriptsScript(NULL), _roomScript(NULL), _roomScriptFork(NULL),
 	_scriptPlayerObject(NULL),
 	_scriptMouseObject(NULL), _gameStateGlobalsObject(NULL), _saveGameIndexObject(NULL), _scriptSystemObject(NULL),
-	_roomObjectState(NULL),
+	_scriptProfiler(NULL), _roomObjectState(NULL),
 	_eventClaimed(EVENT_NONE),
 	_currentRoom(NULL), _framesPerSecond(40), _lastFrameTime(0),
 	_inNewRoomState(kNewRoomStateNone), _newRoomStateWas(kNewRoomStateNone), _inEntersScreenCounter(0),
@@ -152,6 +153,7 @@ AGSEngine::AGSEngine(OSystem *syst, const AGSGameDescription *gameDesc) :
 	_faceTalkingOverlayIndex((uint)-1) {
 
 	DebugMan.addDebugChannel(kDebugLevelGame, "Game", "AGS runtime debugging");
+	DebugMan.addDebugChannel(kDebugLevelProfile, "Profile", "Script profiling (report written on exit)");
 
 	_rnd = new Common::RandomSource("ags");
 	_scriptState = new GlobalScriptState();
@@ -167,6 +169,11 @@ void initSnowRain(AGSEngine *vm);
 void shutdownSnowRain();
 
 AGSEngine::~AGSEngine() {
+	if (_scriptProfiler) {
+		_scriptProfiler->writeReport("ags-profile.txt");
+		_scriptProfiler->writeCollapsedStacks("ags-profile.folded");
+	}
+
 	shutdownSnowRain();
 
 	delete _roomScriptFork;
@@ -218,6 +225,7 @@ AGSEngine::~AGSEngine() {
 	_audio->deregisterScriptObjects();
 
 	delete _scriptState;
+	delete _scriptProfiler;
 
 	delete _scriptPlayerObject;
 	delete _scriptMouseObject;
@@ -257,6 +265,9 @@ void AGSEngine::unpauseGame() {
 }
 
 Common::Error AGSEngine::run() {
+	if (DebugMan.isDebugChannelEnabled(kDebugLevelProfile))
+		_scriptProfiler = new ScriptProfiler();
+
 	if (!init())
 		return Common::kUnknownError;
 
@@ -348,10 +359,10 @@ void AGSEngine::tickGame(bool checkControls) {
 		// Run the room and game script repeatedly_execute
 		// FIXME: use repExecAlways on run_function_on_non_blocking_thread
 		for (uint i = 0; i < _scriptModules.size(); ++i) {
-			runScriptFunction(_scriptModuleForks[i], "repeatedly_execute_always");
+			runScriptFunction(_scriptModuleForks[i], kScriptEventRepeatedlyExecuteAlways);
 		}
-		runScriptFunction(_gameScriptFork, "repeatedly_execute_always");
-		runScriptFunction(_roomScriptFork, "repeatedly_execute_always");
+		runScriptFunction(_gameScriptFork, kScriptEventRepeatedlyExecuteAlways);
+		runScriptFunction(_roomScriptFork, kScriptEventRepeatedlyExecuteAlways);
 
 		queueGameEvent(kEventTextScript, kTextScriptRepeatedlyExecute);
 		queueGameEvent(kEventRunEventBlock, kEventBlockRoom, 0, kRoomEventTick);
@@ -468,8 +479,13 @@ void AGSEngine::tickGame(bool checkControls) {
 	if (_state->_fastForward)
 		return;
 
-	// If we're running faster than the target rate, sleep for a bit.
+	// If we're running faster than the target rate, use the spare time
+	// to decode sprites we'll probably need soon, then sleep for a bit.
 	uint32 time = _system->getMillis();
+	if (time < _lastFrameTime + (1000 / _framesPerSecond)) {
+		if (_sprites->prefetchSome((1000 / _framesPerSecond) - time + _lastFrameTime))
+			time = _system->getMillis();
+	}
 	if (time < _lastFrameTime + (1000 / _framesPerSecond))
 		_system->delayMillis((1000 / _framesPerSecond) - time + _lastFrameTime);
 	_lastFrameTime = _system->getMillis();
@@ -808,6 +824,7 @@ void AGSEngine::draw() {
 	if (_backgroundNeedsUpdate) {
 		_graphics->newRoomPalette();
 		_currentRoom->updateWalkBehinds();
+		_graphics->invalidateAll();
 		_backgroundNeedsUpdate = false;
 	}
 	if (_guiNeedsUpdate) {
@@ -818,6 +835,7 @@ void AGSEngine::draw() {
 	}
 	updateViewport(); // FIXME: only in the absence of a complete overlay?
 	_graphics->draw();
+	_sprites->frameDone();
 
 	if (_state->_shakeLength && _state->_shakeDelay) {
 		if ((_loopCounter % _state->_shakeDelay) < (_state->_shakeDelay / 2))
@@ -850,6 +868,11 @@ void AGSEngine::updateStuff() {
 		if (_characters[i]->update())
 			sheepIds.push_back(i);
 
+	// pick up the scaling for wherever characters ended up
+	for (uint i = 0; i < _characters.size(); ++i)
+		if (_characters[i]->_room == _displayedRoom)
+			_characters[i]->updateZoom();
+
 	// FIXME: sheep
 
 	updateOverlayTimers();
@@ -1117,6 +1140,9 @@ void AGSEngine::loadNewRoom(uint32 id, Character *forChar) {
 
 	// (note: convertCoordinatesToLowRes call was here, now in Room)
 
+	// the room surfaces may have been reloaded in-place
+	_graphics->invalidateAll();
+
 	_state->_roomWidth = _currentRoom->_width;
 	_state->_roomHeight = _currentRoom->_height;
 	_state->_animBackgroundSpeed = _currentRoom->_backgroundSceneAnimSpeed;
@@ -1265,6 +1291,8 @@ void AGSEngine::loadNewRoom(uint32 id, Character *forChar) {
 
 	// FIXME: merge objects
 
+	prefetchRoomSprites();
+
 	_state->_gscriptTimer = (uint)-1; // avoid screw-ups with changing screens
 	_state->_playerOnRegion = 0;
 
@@ -1275,6 +1303,45 @@ void AGSEngine::loadNewRoom(uint32 id, Character *forChar) {
 	invalidateGUI();
 }
 
+static void addViewSprites(GameFile *gameFile, uint view, Common::Array<uint32> &spriteIds) {
+	if (view >= gameFile->_views.size())
+		return;
+
+	const ViewStruct &viewInfo = gameFile->_views[view];
+	for (uint i = 0; i < viewInfo._loops.size(); ++i)
+		for (uint j = 0; j < viewInfo._loops[i]._frames.size(); ++j)
+			spriteIds.push_back(viewInfo._loops[i]._frames[j]._pic);
+}
+
+// queue up everything the new room is likely to draw soon, so it can be
+// decoded while we'd otherwise be idle rather than on first use
+void AGSEngine::prefetchRoomSprites() {
+	Common::Array<uint32> spriteIds;
+
+	for (uint i = 0; i < _currentRoom->_objects.size(); ++i) {
+		RoomObject *obj = _currentRoom->_objects[i];
+		spriteIds.push_back(obj->_spriteId);
+		if (obj->_view != (uint16)-1)
+			addViewSprites(_gameFile, obj->_view, spriteIds);
+	}
+
+	for (uint i = 0; i < _characters.size(); ++i) {
+		Character *chr = _characters[i];
+		if (chr->_room != _displayedRoom)
+			continue;
+		addViewSprites(_gameFile, chr->_view, spriteIds);
+	}
+
+	for (uint i = 0; i < _gameFile->_guiGroups.size(); ++i)
+		if ((int)_gameFile->_guiGroups[i]->_bgPic > 0)
+			spriteIds.push_back(_gameFile->_guiGroups[i]->_bgPic);
+
+	for (uint i = 0; i < _gameFile->_cursors.size(); ++i)
+		spriteIds.push_back(_gameFile->_cursors[i]._pic);
+
+	_sprites->prefetch(spriteIds);
+}
+
 void AGSEngine::unloadOldRoom() {
 	assert(_currentRoom);
 
@@ -3277,7 +3344,7 @@ void AGSEngine::runTextScript(ccInstance *instance, const Common::String &name,
 		uint roomWas = _state->_roomChanges;
 		for (uint i = 0; i < _scriptModules.size(); ++i) {
 			// FIXME: original checks whether the symbol exists first, unnecessary?
-			runScriptFunction(_scriptModules[i], name, params);
+			runScriptFunction(_scriptModules[i], kScriptEventRepeatedlyExecute, params);
 			// FIXME: check restore game also
 			if (roomWas != _state->_roomChanges)
 				return;
@@ -3787,10 +3854,18 @@ Common::String AGSEngine::getStringProperty(const Common::String &name, const Co
 }
 
 bool AGSEngine::runScriptFunction(ccInstance *instance, const Common::String &name, const Common::Array<RuntimeValue> &params) {
-	if (!prepareTextScript(instance, name))
+	return runScriptExport(instance, instance->findExport(name), params);
+}
+
+bool AGSEngine::runScriptFunction(ccInstance *instance, ScriptEvent event, const Common::Array<RuntimeValue> &params) {
+	return runScriptExport(instance, instance->getEventExport(event), params);
+}
+
+bool AGSEngine::runScriptExport(ccInstance *instance, int exportId, const Common::Array<RuntimeValue> &params) {
+	if (!prepareTextScript(instance, exportId))
 		return false;
 
-	instance->call(name, params);
+	instance->call((uint)exportId, params);
 
 	// non-zero if failed, except 100 if aborted
 	// TODO: original checked -2 but we don't use that, right?
@@ -3805,12 +3880,12 @@ bool AGSEngine::runScriptFunction(ccInstance *instance, const Common::String &na
 	return true;
 }
 
-bool AGSEngine::prepareTextScript(ccInstance *instance, const Common::String &name) {
-	if (!instance->exportsSymbol(name))
+bool AGSEngine::prepareTextScript(ccInstance *instance, int exportId) {
+	if (exportId == -1)
 		return false;
 
 	if (instance->isRunning()) {
-		warning("script was already running, when trying to run '%s'", name.c_str());
+		warning("script was already running, when trying to run '%s'", instance->getExportName(exportId).c_str());
 		return false;
 	}
 
@@ -260,6 +260,8 @@ public:
 
 	struct ScriptImport resolveImport(const Common::String &name, bool mustSucceed = true);
 	class GlobalScriptState *getScriptState();
+	// NULL unless the 'profile' debug channel is enabled
+	class ScriptProfiler *getScriptProfiler() { return _scriptProfiler; }
 
 	Common::RandomSource *getRandomSource() { return _rnd; }
 
@@ -458,6 +460,7 @@ private:
 	ccInstance *_roomScript, *_roomScriptFork;
 
 	class GlobalScriptState *_scriptState;
+	class ScriptProfiler *_scriptProfiler;
 	struct RoomObjectState *_roomObjectState;
 
 	ScriptObject *_scriptPlayerObject;
@@ -495,6 +498,7 @@ private:
 	void firstRoomInitialization();
 	void loadNewRoom(uint32 id, Character *forChar);
 	void unloadOldRoom();
+	void prefetchRoomSprites();
 	void checkNewRoom();
 	void newRoom(uint roomId);
 
@@ -505,7 +509,9 @@ private:
 	int runDialogRequest(uint request);
 
 	bool runScriptFunction(ccInstance *instance, const Common::String &name, const Common::Array<RuntimeValue> &params = Common::Array<RuntimeValue>());
-	bool prepareTextScript(ccInstance *instance, const Common::String &name);
+	bool runScriptFunction(ccInstance *instance, ScriptEvent event, const Common::Array<RuntimeValue> &params = Common::Array<RuntimeValue>());
+	bool runScriptExport(ccInstance *instance, int exportId, const Common::Array<RuntimeValue> &params);
+	bool prepareTextScript(ccInstance *instance, int exportId);
 	void postScriptCleanup();
 
 	const ADGameFileDescription *getGameFiles() const;
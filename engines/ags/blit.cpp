@@ -0,0 +1,541 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "engines/ags/blit.h"
+
+#include "common/textconsole.h"
+#include "common/util.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define AGS_BLIT_SSE2
+#elif (defined(__ARM_NEON__) || defined(__ARM_NEON)) && !defined(SCUMM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define AGS_BLIT_NEON
+#endif
+
+namespace AGS {
+
+/*
+ * Generic kernels. These are also used for the leftovers at the end of
+ * rows which the SIMD kernels don't handle. When mirrored, source pixel
+ * x ends up in destination pixel (width - 1 - x).
+ */
+
+template<bool Mirrored>
+static void keyedRow8(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	byte *dest = (byte *)destPtr + (Mirrored ? width - 1 : 0);
+	const byte *src = (const byte *)srcPtr;
+	const int step = Mirrored ? -1 : 1;
+
+	for (uint x = 0; x < width; ++x, dest += step) {
+		byte data = src[x];
+		if (data != key)
+			*dest = data;
+	}
+}
+
+template<bool Mirrored>
+static void keyedRow16(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	uint16 *dest = (uint16 *)destPtr + (Mirrored ? width - 1 : 0);
+	const uint16 *src = (const uint16 *)srcPtr;
+	const int step = Mirrored ? -1 : 1;
+
+	for (uint x = 0; x < width; ++x, dest += step) {
+		uint16 srcData = src[x];
+		if (srcData != key)
+			*dest = srcData;
+	}
+}
+
+template<bool Mirrored>
+static void blendRow16(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	uint16 *dest = (uint16 *)destPtr + (Mirrored ? width - 1 : 0);
+	const uint16 *src = (const uint16 *)srcPtr;
+	const int step = Mirrored ? -1 : 1;
+
+	for (uint x = 0; x < width; ++x, dest += step) {
+		uint16 srcData = src[x];
+		if (srcData == key)
+			continue;
+		uint16 destData = *dest;
+
+		// spread the 565 channels out so they can be blended in one go
+		uint32 blendDest = (destData | (destData << 16)) & 0x7E0F81F;
+		uint32 blendSrc = (srcData | (srcData << 16)) & 0x7E0F81F;
+		uint32 blended = (blendSrc - blendDest) * alpha / 32 + blendDest;
+		blended &= 0x7E0F81F;
+		*dest = (blended & 0xFFFF) | (blended >> 16);
+	}
+}
+
+template<bool Mirrored>
+static void keyedRow32(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	uint32 *dest = (uint32 *)destPtr + (Mirrored ? width - 1 : 0);
+	const uint32 *src = (const uint32 *)srcPtr;
+	const int step = Mirrored ? -1 : 1;
+
+	for (uint x = 0; x < width; ++x, dest += step) {
+		uint32 srcData = src[x];
+		if ((srcData & 0xffffff) != key)
+			*dest = srcData | 0xff000000;
+	}
+}
+
+static inline uint32 blendPixel32(uint32 srcData, uint32 destData, uint alpha) {
+	uint32 blendedRB = ((srcData & 0xFF00FF) - (destData & 0xFF00FF)) * alpha / 256 + (destData & 0xFF00FF);
+	uint32 blended = ((srcData & 0xFF00) - (destData & 0xFF00)) * alpha / 256 + (destData & 0xFF00);
+	return (blended & 0xFF00) | (blendedRB & 0xFF00FF) | 0xFF000000;
+}
+
+template<bool Mirrored>
+static void blendRow32(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	uint32 *dest = (uint32 *)destPtr + (Mirrored ? width - 1 : 0);
+	const uint32 *src = (const uint32 *)srcPtr;
+	const int step = Mirrored ? -1 : 1;
+
+	for (uint x = 0; x < width; ++x, dest += step) {
+		uint32 srcData = src[x];
+		if ((srcData & 0xffffff) != key)
+			*dest = blendPixel32(srcData, *dest, alpha);
+	}
+}
+
+template<bool Mirrored>
+static void alphaBlendRow32(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	uint32 *dest = (uint32 *)destPtr + (Mirrored ? width - 1 : 0);
+	const uint32 *src = (const uint32 *)srcPtr;
+	const int step = Mirrored ? -1 : 1;
+
+	for (uint x = 0; x < width; ++x, dest += step) {
+		uint32 srcData = src[x];
+		if ((srcData & 0xffffff) == key)
+			continue;
+
+		uint pixelAlpha = srcData >> 24;
+		if (pixelAlpha)
+			pixelAlpha++;
+		*dest = blendPixel32(srcData, *dest, pixelAlpha);
+	}
+}
+
+template<bool Mirrored>
+static void alphaAddRow32(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	uint32 *dest = (uint32 *)destPtr + (Mirrored ? width - 1 : 0);
+	const uint32 *src = (const uint32 *)srcPtr;
+	const int step = Mirrored ? -1 : 1;
+
+	for (uint x = 0; x < width; ++x, dest += step) {
+		uint32 srcData = src[x];
+		if ((srcData & 0xffffff) == key)
+			continue;
+
+		uint pixelAlpha = MIN<uint>(0xff, (srcData >> 24) + (*dest >> 24));
+		*dest = (pixelAlpha << 24) | (srcData & 0xffffff);
+	}
+}
+
+/*
+ * SIMD kernels. These process as many whole vectors as fit into the row
+ * and leave the rest to the generic kernels above. Blending is done per
+ * channel as (src * alpha + dest * (max - alpha)) >> shift, which gives
+ * exactly the same results as the packed versions above.
+ */
+
+#define BLIT_ROW_TAIL(generic, elemType, done) \
+	if (Mirrored) \
+		generic<true>(destPtr, (const elemType *)srcPtr + (done), width - (done), key, alpha); \
+	else \
+		generic<false>((elemType *)destPtr + (done), (const elemType *)srcPtr + (done), width - (done), key, alpha)
+
+#if defined(AGS_BLIT_SSE2)
+
+static inline __m128i select128(__m128i mask, __m128i ifSet, __m128i ifClear) {
+	return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+}
+
+static inline __m128i reverse16(__m128i v) {
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+	return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+static inline __m128i reverse32(__m128i v) {
+	return _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+// (SSE2 has no cheap byte reversal, so mirrored 8bpp stays generic)
+static void keyedRow8Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	byte *dest = (byte *)destPtr;
+	const byte *src = (const byte *)srcPtr;
+	const __m128i keyVec = _mm_set1_epi8((char)key);
+
+	uint x = 0;
+	for (; x + 16 <= width; x += 16) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dest + x));
+		_mm_storeu_si128((__m128i *)(dest + x), select128(_mm_cmpeq_epi8(s, keyVec), d, s));
+	}
+
+	keyedRow8<false>(dest + x, src + x, width - x, key, alpha);
+}
+
+template<bool Mirrored>
+static void keyedRow16Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	uint16 *dest = (uint16 *)destPtr;
+	const uint16 *src = (const uint16 *)srcPtr;
+	const __m128i keyVec = _mm_set1_epi16((int16)key);
+
+	uint x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+		if (Mirrored)
+			s = reverse16(s);
+		__m128i *out = (__m128i *)(dest + (Mirrored ? width - x - 8 : x));
+		__m128i d = _mm_loadu_si128(out);
+		_mm_storeu_si128(out, select128(_mm_cmpeq_epi16(s, keyVec), d, s));
+	}
+
+	BLIT_ROW_TAIL(keyedRow16, uint16, x);
+}
+
+template<bool Mirrored>
+static void blendRow16Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	uint16 *dest = (uint16 *)destPtr;
+	const uint16 *src = (const uint16 *)srcPtr;
+	const __m128i keyVec = _mm_set1_epi16((int16)key);
+	const __m128i srcWeight = _mm_set1_epi16((int16)alpha);
+	const __m128i destWeight = _mm_set1_epi16((int16)(32 - alpha));
+	const __m128i mask5 = _mm_set1_epi16(0x1f);
+	const __m128i mask6 = _mm_set1_epi16(0x3f);
+
+	uint x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+		if (Mirrored)
+			s = reverse16(s);
+		__m128i *out = (__m128i *)(dest + (Mirrored ? width - x - 8 : x));
+		__m128i d = _mm_loadu_si128(out);
+
+		__m128i r = _mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(s, 11), srcWeight),
+			_mm_mullo_epi16(_mm_srli_epi16(d, 11), destWeight));
+		__m128i g = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(s, 5), mask6), srcWeight),
+			_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(d, 5), mask6), destWeight));
+		__m128i b = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(s, mask5), srcWeight),
+			_mm_mullo_epi16(_mm_and_si128(d, mask5), destWeight));
+		__m128i blended = _mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(r, 5), 11),
+			_mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(g, 5), 5), _mm_srli_epi16(b, 5)));
+
+		_mm_storeu_si128(out, select128(_mm_cmpeq_epi16(s, keyVec), d, blended));
+	}
+
+	BLIT_ROW_TAIL(blendRow16, uint16, x);
+}
+
+// blends the 8 channels in each half using the given 16-bit weights
+static inline __m128i blend128(__m128i s, __m128i d, __m128i srcWeightLo, __m128i srcWeightHi) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i full = _mm_set1_epi16(256);
+
+	__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), srcWeightLo),
+		_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(full, srcWeightLo)));
+	__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), srcWeightHi),
+		_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(full, srcWeightHi)));
+
+	return _mm_or_si128(_mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)),
+		_mm_set1_epi32((int)0xff000000));
+}
+
+// shared by the 32bpp kernels; Op decides what happens to non-key pixels
+template<bool Mirrored, typename Op>
+static inline void row32Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, const Op &op) {
+	uint32 *dest = (uint32 *)destPtr;
+	const uint32 *src = (const uint32 *)srcPtr;
+	const __m128i keyVec = _mm_set1_epi32((int)key);
+	const __m128i colorMask = _mm_set1_epi32(0xffffff);
+
+	for (uint x = 0; x + 4 <= width; x += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+		if (Mirrored)
+			s = reverse32(s);
+		__m128i *out = (__m128i *)(dest + (Mirrored ? width - x - 4 : x));
+		__m128i d = _mm_loadu_si128(out);
+		__m128i isKey = _mm_cmpeq_epi32(_mm_and_si128(s, colorMask), keyVec);
+		_mm_storeu_si128(out, select128(isKey, d, op(s, d)));
+	}
+}
+
+struct KeyedOp32 {
+	__m128i operator()(__m128i s, __m128i d) const {
+		return _mm_or_si128(s, _mm_set1_epi32((int)0xff000000));
+	}
+};
+
+struct BlendOp32 {
+	__m128i _srcWeight;
+	BlendOp32(uint alpha) : _srcWeight(_mm_set1_epi16((int16)alpha)) { }
+	__m128i operator()(__m128i s, __m128i d) const {
+		return blend128(s, d, _srcWeight, _srcWeight);
+	}
+};
+
+struct AlphaBlendOp32 {
+	__m128i operator()(__m128i s, __m128i d) const {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi16(1);
+
+		// spread each pixel's alpha over its channels; nonzero alpha gets +1
+		__m128i lo = _mm_unpacklo_epi8(s, zero);
+		lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		lo = _mm_add_epi16(lo, _mm_min_epi16(lo, one));
+		__m128i hi = _mm_unpackhi_epi8(s, zero);
+		hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		hi = _mm_add_epi16(hi, _mm_min_epi16(hi, one));
+
+		return blend128(s, d, lo, hi);
+	}
+};
+
+template<bool Mirrored>
+static void keyedRow32Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	row32Simd<Mirrored>(destPtr, srcPtr, width, key, KeyedOp32());
+	BLIT_ROW_TAIL(keyedRow32, uint32, width & ~3);
+}
+
+template<bool Mirrored>
+static void blendRow32Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	row32Simd<Mirrored>(destPtr, srcPtr, width, key, BlendOp32(alpha));
+	BLIT_ROW_TAIL(blendRow32, uint32, width & ~3);
+}
+
+template<bool Mirrored>
+static void alphaBlendRow32Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	row32Simd<Mirrored>(destPtr, srcPtr, width, key, AlphaBlendOp32());
+	BLIT_ROW_TAIL(alphaBlendRow32, uint32, width & ~3);
+}
+
+#elif defined(AGS_BLIT_NEON)
+
+static inline uint8x16_t reverse8(uint8x16_t v) {
+	return vcombine_u8(vrev64_u8(vget_high_u8(v)), vrev64_u8(vget_low_u8(v)));
+}
+
+static inline uint16x8_t reverse16(uint16x8_t v) {
+	return vcombine_u16(vrev64_u16(vget_high_u16(v)), vrev64_u16(vget_low_u16(v)));
+}
+
+template<bool Mirrored>
+static void keyedRow8Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	byte *dest = (byte *)destPtr;
+	const byte *src = (const byte *)srcPtr;
+	const uint8x16_t keyVec = vdupq_n_u8((uint8)key);
+
+	uint x = 0;
+	for (; x + 16 <= width; x += 16) {
+		uint8x16_t s = vld1q_u8(src + x);
+		if (Mirrored)
+			s = reverse8(s);
+		byte *out = dest + (Mirrored ? width - x - 16 : x);
+		vst1q_u8(out, vbslq_u8(vceqq_u8(s, keyVec), vld1q_u8(out), s));
+	}
+
+	BLIT_ROW_TAIL(keyedRow8, byte, x);
+}
+
+template<bool Mirrored>
+static void keyedRow16Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	uint16 *dest = (uint16 *)destPtr;
+	const uint16 *src = (const uint16 *)srcPtr;
+	const uint16x8_t keyVec = vdupq_n_u16((uint16)key);
+
+	uint x = 0;
+	for (; x + 8 <= width; x += 8) {
+		uint16x8_t s = vld1q_u16(src + x);
+		if (Mirrored)
+			s = reverse16(s);
+		uint16 *out = dest + (Mirrored ? width - x - 8 : x);
+		vst1q_u16(out, vbslq_u16(vceqq_u16(s, keyVec), vld1q_u16(out), s));
+	}
+
+	BLIT_ROW_TAIL(keyedRow16, uint16, x);
+}
+
+template<bool Mirrored>
+static void blendRow16Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	uint16 *dest = (uint16 *)destPtr;
+	const uint16 *src = (const uint16 *)srcPtr;
+	const uint16x8_t keyVec = vdupq_n_u16((uint16)key);
+	const uint16x8_t srcWeight = vdupq_n_u16((uint16)alpha);
+	const uint16x8_t destWeight = vdupq_n_u16((uint16)(32 - alpha));
+	const uint16x8_t mask5 = vdupq_n_u16(0x1f);
+	const uint16x8_t mask6 = vdupq_n_u16(0x3f);
+
+	uint x = 0;
+	for (; x + 8 <= width; x += 8) {
+		uint16x8_t s = vld1q_u16(src + x);
+		if (Mirrored)
+			s = reverse16(s);
+		uint16 *out = dest + (Mirrored ? width - x - 8 : x);
+		uint16x8_t d = vld1q_u16(out);
+
+		uint16x8_t r = vmlaq_u16(vmulq_u16(vshrq_n_u16(s, 11), srcWeight), vshrq_n_u16(d, 11), destWeight);
+		uint16x8_t g = vmlaq_u16(vmulq_u16(vandq_u16(vshrq_n_u16(s, 5), mask6), srcWeight),
+			vandq_u16(vshrq_n_u16(d, 5), mask6), destWeight);
+		uint16x8_t b = vmlaq_u16(vmulq_u16(vandq_u16(s, mask5), srcWeight), vandq_u16(d, mask5), destWeight);
+		uint16x8_t blended = vorrq_u16(vshlq_n_u16(vshrq_n_u16(r, 5), 11),
+			vorrq_u16(vshlq_n_u16(vshrq_n_u16(g, 5), 5), vshrq_n_u16(b, 5)));
+
+		vst1q_u16(out, vbslq_u16(vceqq_u16(s, keyVec), d, blended));
+	}
+
+	BLIT_ROW_TAIL(blendRow16, uint16, x);
+}
+
+static inline uint8x8_t blendChannel(uint8x8_t s, uint8x8_t d, uint16x8_t srcWeight) {
+	uint16x8_t destWeight = vsubq_u16(vdupq_n_u16(256), srcWeight);
+	return vshrn_n_u16(vmlaq_u16(vmulq_u16(vmovl_u8(s), srcWeight), vmovl_u8(d), destWeight), 8);
+}
+
+// shared by the 32bpp kernels, working on 8 pixels split into B, G, R and
+// A planes; Op decides what happens to non-key pixels
+template<bool Mirrored, typename Op>
+static inline void row32Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, const Op &op) {
+	uint32 *dest = (uint32 *)destPtr;
+	const uint32 *src = (const uint32 *)srcPtr;
+	const uint8x8_t keyB = vdup_n_u8(key & 0xff);
+	const uint8x8_t keyG = vdup_n_u8((key >> 8) & 0xff);
+	const uint8x8_t keyR = vdup_n_u8((key >> 16) & 0xff);
+
+	for (uint x = 0; x + 8 <= width; x += 8) {
+		uint8x8x4_t s = vld4_u8((const uint8 *)(src + x));
+		if (Mirrored) {
+			for (uint i = 0; i < 4; ++i)
+				s.val[i] = vrev64_u8(s.val[i]);
+		}
+		uint8 *out = (uint8 *)(dest + (Mirrored ? width - x - 8 : x));
+		uint8x8x4_t d = vld4_u8(out);
+
+		uint8x8_t isKey = vand_u8(vand_u8(vceq_u8(s.val[0], keyB), vceq_u8(s.val[1], keyG)), vceq_u8(s.val[2], keyR));
+		uint8x8x4_t result = op(s, d);
+		for (uint i = 0; i < 4; ++i)
+			result.val[i] = vbsl_u8(isKey, d.val[i], result.val[i]);
+		vst4_u8(out, result);
+	}
+}
+
+struct KeyedOp32 {
+	uint8x8x4_t operator()(uint8x8x4_t s, uint8x8x4_t d) const {
+		s.val[3] = vdup_n_u8(0xff);
+		return s;
+	}
+};
+
+struct BlendOp32 {
+	uint16x8_t _srcWeight;
+	BlendOp32(uint alpha) : _srcWeight(vdupq_n_u16((uint16)alpha)) { }
+	uint8x8x4_t operator()(uint8x8x4_t s, uint8x8x4_t d) const {
+		for (uint i = 0; i < 3; ++i)
+			s.val[i] = blendChannel(s.val[i], d.val[i], _srcWeight);
+		s.val[3] = vdup_n_u8(0xff);
+		return s;
+	}
+};
+
+struct AlphaBlendOp32 {
+	uint8x8x4_t operator()(uint8x8x4_t s, uint8x8x4_t d) const {
+		// nonzero alpha gets +1
+		uint16x8_t srcWeight = vmovl_u8(s.val[3]);
+		srcWeight = vaddq_u16(srcWeight, vminq_u16(srcWeight, vdupq_n_u16(1)));
+		for (uint i = 0; i < 3; ++i)
+			s.val[i] = blendChannel(s.val[i], d.val[i], srcWeight);
+		s.val[3] = vdup_n_u8(0xff);
+		return s;
+	}
+};
+
+template<bool Mirrored>
+static void keyedRow32Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	row32Simd<Mirrored>(destPtr, srcPtr, width, key, KeyedOp32());
+	BLIT_ROW_TAIL(keyedRow32, uint32, width & ~7);
+}
+
+template<bool Mirrored>
+static void blendRow32Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	row32Simd<Mirrored>(destPtr, srcPtr, width, key, BlendOp32(alpha));
+	BLIT_ROW_TAIL(blendRow32, uint32, width & ~7);
+}
+
+template<bool Mirrored>
+static void alphaBlendRow32Simd(void *destPtr, const void *srcPtr, uint width, uint32 key, uint alpha) {
+	row32Simd<Mirrored>(destPtr, srcPtr, width, key, AlphaBlendOp32());
+	BLIT_ROW_TAIL(alphaBlendRow32, uint32, width & ~7);
+}
+
+#endif
+
+#undef BLIT_ROW_TAIL
+
+static inline BlitRowFunc pickRowFunc(BlitRowFunc normal, BlitRowFunc mirrored, bool isMirrored) {
+	return isMirrored ? mirrored : normal;
+}
+
+#if defined(AGS_BLIT_SSE2) || defined(AGS_BLIT_NEON)
+#define ROW_FUNC(name, mirrored) pickRowFunc(&name##Simd<false>, &name##Simd<true>, mirrored)
+#else
+#define ROW_FUNC(name, mirrored) pickRowFunc(&name<false>, &name<true>, mirrored)
+#endif
+
+BlitRowFunc getBlitRowFunc(BlitMode mode, uint bytesPerPixel, bool mirrored) {
+	switch (bytesPerPixel) {
+	case 1:
+		if (mode != kBlitKeyed)
+			break;
+#if defined(AGS_BLIT_SSE2)
+		return pickRowFunc(&keyedRow8Simd, &keyedRow8<true>, mirrored);
+#else
+		return ROW_FUNC(keyedRow8, mirrored);
+#endif
+	case 2:
+		if (mode == kBlitKeyed)
+			return ROW_FUNC(keyedRow16, mirrored);
+		if (mode == kBlitBlend)
+			return ROW_FUNC(blendRow16, mirrored);
+		break;
+	case 4:
+		switch (mode) {
+		case kBlitKeyed:
+			return ROW_FUNC(keyedRow32, mirrored);
+		case kBlitBlend:
+			return ROW_FUNC(blendRow32, mirrored);
+		case kBlitAlphaBlend:
+			return ROW_FUNC(alphaBlendRow32, mirrored);
+		case kBlitAlphaAdd:
+			return pickRowFunc(&alphaAddRow32<false>, &alphaAddRow32<true>, mirrored);
+		}
+		break;
+	}
+
+	error("getBlitRowFunc: blit mode %d not supported for %dBpp", mode, bytesPerPixel);
+}
+
+#undef ROW_FUNC
+
+} // End of namespace AGS
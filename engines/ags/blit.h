@@ -0,0 +1,57 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef AGS_BLIT_H
+#define AGS_BLIT_H
+
+#include "common/scummsys.h"
+
+namespace AGS {
+
+enum BlitMode {
+	// copy every pixel which isn't the transparent key color
+	kBlitKeyed,
+	// blend non-key pixels with a constant alpha
+	kBlitBlend,
+	// blend non-key pixels using their own alpha channel (32bpp only)
+	kBlitAlphaBlend,
+	// add the alpha of non-key pixels to the destination alpha (32bpp only)
+	kBlitAlphaAdd
+};
+
+/**
+ * Draws one row of pixels. `dest` always points at the leftmost pixel
+ * of the destination row; mirrored kernels fill it from right to left.
+ * `alpha` is the source weight for kBlitBlend: 0-32 for 16bpp, 0-256
+ * for 32bpp. 32bpp output pixels are always opaque (for non-add modes).
+ */
+typedef void (*BlitRowFunc)(void *dest, const void *src, uint width, uint32 key, uint alpha);
+
+/**
+ * Returns the best available row kernel for the given mode, pixel
+ * size (in bytes) and mirroring, so that none of these need to be
+ * checked per-pixel.
+ */
+BlitRowFunc getBlitRowFunc(BlitMode mode, uint bytesPerPixel, bool mirrored);
+
+} // End of namespace AGS
+
+#endif // AGS_BLIT_H
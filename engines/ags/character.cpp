@@ -60,6 +60,9 @@ Character::Character(AGSEngine *vm) : _vm(vm) {
 	_xWas = INVALID_X;
 	_yWas = 0;
 	_zoom = 100;
+	_drawSurface = NULL;
+	_drawSurfaceTick = 0;
+	_drawSpriteId = 0;
 	_tintR = 0;
 	_tintG = 0;
 	_tintB = 0;
@@ -822,7 +825,7 @@ void Character::walk(int x, int y, bool ignoreWalkable, bool autoWalkAnims) {
 
 	Graphics::Surface *walkableMask = _vm->getWalkableMaskFor(_indexId);
 
-	if (findPath(_vm, from, to, walkableMask, &_moveList, moveSpeedX, moveSpeedY, true, ignoreWalkable)) {
+	if (findPath(_vm, from, to, walkableMask, _vm->getCurrentRoom()->getWalkableAreaInfo(), &_moveList, moveSpeedX, moveSpeedY, true, ignoreWalkable)) {
 		_walking = 1;
 		_moveList._direct = ignoreWalkable;
 
@@ -1745,17 +1748,24 @@ Common::Point Character::getDrawPos() {
 	if (_frame >= loop._frames.size())
 		_frame = 0;
 
-	uint spriteId = loop._frames[_frame]._pic;
-
 	return Common::Point(_vm->multiplyUpCoordinate(_x) - getDrawWidth()/2 + _picXOffs,
-		_vm->multiplyUpCoordinate(_y) - _vm->getSprites()->getSpriteHeight(spriteId) -
-		_vm->multiplyUpCoordinate(_z) + _picYOffs);
+		_vm->multiplyUpCoordinate(_y) - getDrawHeight() - _vm->multiplyUpCoordinate(_z) + _picYOffs);
 }
 
 int Character::getBaseline() const {
 	return (_baseline >= 1) ? _baseline : _y;
 }
 
+// pick up the scaling of the walkable area we're standing on
+void Character::updateZoom() {
+	if (_flags & CHF_MANUALSCALING)
+		return;
+
+	Common::Point pos(_x, _y);
+	uint zoom = _vm->getAreaScalingFor(_vm->getWalkableAreaAt(pos), pos);
+	_zoom = (zoom == (uint)-1) ? 100 : zoom;
+}
+
 int Character::getDrawOrder() const {
 	return getBaseline() + ((_flags & CHF_NOWALKBEHINDS) ? _vm->getCurrentRoom()->_height : 0);
 }
@@ -1763,15 +1773,27 @@ int Character::getDrawOrder() const {
 const Graphics::Surface *Character::getDrawSurface() {
 	uint spriteId = _vm->getViewFrame(_view, _loop, _frame)->_pic;
 
-	return _vm->getSprites()->getSprite(spriteId)->_surface; // FIXME
+	SpriteTransform transform;
+	transform._scale = _zoom;
+	transform.setLighting(this);
+
+	uint32 frameTick = _vm->getSprites()->getFrameTick();
+	if (_drawSurface && _drawSurfaceTick == frameTick && _drawSpriteId == spriteId && _drawTransform == transform)
+		return _drawSurface;
+
+	_drawSurface = _vm->getSprites()->getTransformedSprite(spriteId, transform);
+	_drawSurfaceTick = frameTick;
+	_drawSpriteId = spriteId;
+	_drawTransform = transform;
+	return _drawSurface;
 }
 
 uint Character::getDrawWidth() {
-	return getDrawSurface()->w; // FIXME
+	return getDrawSurface()->w;
 }
 
 uint Character::getDrawHeight() {
-	return getDrawSurface()->h; // FIXME
+	return getDrawSurface()->h;
 }
 
 uint Character::getDrawTransparency() {
@@ -1783,11 +1805,33 @@ bool Character::isDrawMirrored() {
 }
 
 int Character::getDrawLightLevel() {
-	return 0; // FIXME
+	// an explicit tint replaces any lighting
+	if (_flags & (CHF_NOLIGHTING | CHF_HASTINT))
+		return 0;
+
+	int lightLevel, tintAmount;
+	byte red, green, blue;
+	_vm->getCurrentRoom()->getLightingAt(_x, _y, lightLevel, tintAmount, red, green, blue);
+	return lightLevel;
 }
 
 void Character::getDrawTint(int &lightLevel, int &luminance, byte &red, byte &green, byte &blue) {
-	// FIXME
+	if (_flags & CHF_HASTINT) {
+		lightLevel = _tintLevel;
+		luminance = _tintLight;
+		red = _tintR;
+		green = _tintG;
+		blue = _tintB;
+		return;
+	}
+
+	lightLevel = 0;
+	luminance = 255;
+	if (_flags & CHF_NOLIGHTING)
+		return;
+
+	int regionLight;
+	_vm->getCurrentRoom()->getLightingAt(_x, _y, regionLight, lightLevel, red, green, blue);
 }
 
 } // End of namespace AGS
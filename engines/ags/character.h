@@ -33,6 +33,7 @@
 #include "engines/ags/drawable.h"
 #include "engines/ags/pathfinder.h"
 #include "engines/ags/scriptobj.h"
+#include "engines/ags/sprites.h"
 
 namespace AGS {
 
@@ -168,6 +169,7 @@ public:
 	int getEffectiveY() { return _y - _z; }
 
 	int getBaseline() const;
+	void updateZoom();
 
 	virtual Common::Point getDrawPos();
 	virtual int getDrawOrder() const;
@@ -184,6 +186,12 @@ public:
 protected:
 	AGSEngine *_vm;
 
+	// the last transformed sprite, reused within a frame while the transform matches
+	const Graphics::Surface *_drawSurface;
+	uint32 _drawSurfaceTick;
+	uint _drawSpriteId;
+	SpriteTransform _drawTransform;
+
 	void fixPlayerSprite();
 	int needMoveSteps();
 	bool doNextMoveStep();
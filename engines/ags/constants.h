@@ -30,7 +30,8 @@
 namespace AGS {
 
 enum kDebugLevels {
-	kDebugLevelGame		= 1 << 0
+	kDebugLevelGame		= 1 << 0,
+	kDebugLevelProfile	= 1 << 1
 };
 
 extern const char *kGameDataNameV2;
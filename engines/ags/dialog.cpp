@@ -220,6 +220,7 @@ void DialogOptionsDrawable::invalidate() {
 	// FIXME
 
 	drawDialogOptions();
+	drawSurfaceChanged();
 }
 
 void DialogOptionsDrawable::drawDialogOptions() {
@@ -58,6 +58,18 @@ public:
 	virtual bool isDrawMirrored() = 0;
 	virtual int getDrawLightLevel() = 0;
 	virtual void getDrawTint(int &lightLevel, int &luminance, byte &red, byte &green, byte &blue) = 0;
+
+	// bumped whenever the draw surface is modified in-place, so the
+	// compositor knows to redraw the area it covers
+	uint getDrawGeneration() const { return _drawGeneration; }
+	void drawSurfaceChanged() { _drawGeneration++; }
+
+	// unique for every drawable ever created, unlike its address
+	uint getDrawId() const { return _drawId; }
+
+protected:
+	uint _drawId;
+	uint _drawGeneration;
 };
 
 } // End of namespace AGS
@@ -28,6 +28,7 @@
 #include "engines/ags/ags.h"
 #include "engines/ags/constants.h"
 #include "engines/ags/gamestate.h"
+#include "engines/ags/graphics.h"
 #include "engines/ags/room.h"
 
 #include "graphics/surface.h"
@@ -98,6 +99,9 @@ void DrawingSurface::finishedDrawing(bool readOnly) {
 	if (_type == dstRoomBackground)
 		if (_id == _vm->_state->_bgFrame)
 			_vm->invalidateBackground();
+
+	// the surface might be on-screen (e.g. as a sprite)
+	_vm->_graphics->invalidateAll();
 }
 
 } // End of namespace AGS
@@ -33,30 +33,42 @@ ScriptDynamicArray::ScriptDynamicArray(uint32 elementSize, uint32 elementCount,
 	_elementSize = elementSize;
 	_isManaged = isManaged;
 
-	_array.resize(elementCount);
+	if (_isManaged) {
+		_objects.resize(elementCount);
+		for (uint i = 0; i < _objects.size(); ++i)
+			_objects[i] = NULL;
+	} else {
+		_data.resize(elementSize * elementCount);
+		if (_data.size())
+			memset(&_data[0], 0, _data.size());
+	}
 }
 
 ScriptDynamicArray::~ScriptDynamicArray() {
+	for (uint i = 0; i < _objects.size(); ++i)
+		if (_objects[i])
+			_objects[i]->DecRef();
+}
+
+void ScriptDynamicArray::checkRange(const char *func, uint offset, uint count) {
+	if (offset + count > _data.size() || offset + count < offset)
+		error("%s: offset %d is beyond end of dynamic array (%d) (size %d)", func, offset, _elementSize, _elementCount);
 }
 
 uint32 ScriptDynamicArray::readUint32(uint offset) {
 	assert(!_isManaged);
 	assert(_elementSize == 4);
 	assert(offset % _elementSize == 0);
-	uint32 objectId = offset / _elementSize;
-	if (objectId >= _array.size())
-		error("readUint32: offset %d is beyond end of dynamic array (%d) (size %d)", offset, _elementSize, _array.size());
-	return _array[objectId]._value;
+	checkRange("readUint32", offset, 4);
+	return READ_LE_UINT32(&_data[offset]);
 }
 
 bool ScriptDynamicArray::writeUint32(uint offset, uint value) {
 	assert(!_isManaged);
 	assert(_elementSize == 4);
 	assert(offset % _elementSize == 0);
-	uint32 objectId = offset / _elementSize;
-	if (objectId >= _array.size())
-		error("writeUint32: offset %d is beyond end of dynamic array (%d) (size %d)", offset, _elementSize, _array.size());
-	_array[objectId] = value;
+	checkRange("writeUint32", offset, 4);
+	WRITE_LE_UINT32(&_data[offset], value);
 	return true;
 }
 
@@ -64,40 +76,69 @@ uint16 ScriptDynamicArray::readUint16(uint offset) {
 	assert(!_isManaged);
 	assert(_elementSize == 2);
 	assert(offset % _elementSize == 0);
-	uint32 objectId = offset / _elementSize;
-	if (objectId >= _array.size())
-		error("readUint16: offset %d is beyond end of dynamic array (%d) (size %d)", offset, _elementSize, _array.size());
-	return _array[objectId]._value;
+	checkRange("readUint16", offset, 2);
+	return READ_LE_UINT16(&_data[offset]);
 }
 
 bool ScriptDynamicArray::writeUint16(uint offset, uint16 value) {
 	assert(!_isManaged);
 	assert(_elementSize == 2);
 	assert(offset % _elementSize == 0);
-	uint32 objectId = offset / _elementSize;
-	if (objectId >= _array.size())
-		error("writeUint16: offset %d is beyond end of dynamic array (%d) (size %d)", offset, _elementSize, _array.size());
-	_array[objectId] = value;
+	checkRange("writeUint16", offset, 2);
+	WRITE_LE_UINT16(&_data[offset], value);
 	return true;
 }
 
 byte ScriptDynamicArray::readByte(uint offset) {
 	assert(!_isManaged);
 	assert(_elementSize == 1);
-	uint32 objectId = offset;
-	if (objectId >= _array.size())
-		error("readByte: offset %d is beyond end of dynamic array (%d) (size %d)", offset, _elementSize, _array.size());
-	return _array[objectId]._value;
+	checkRange("readByte", offset, 1);
+	return _data[offset];
 }
 
 bool ScriptDynamicArray::writeByte(uint offset, byte value) {
 	assert(!_isManaged);
 	assert(_elementSize == 1);
-	uint32 objectId = offset;
-	if (objectId >= _array.size())
-		error("writeByte: offset %d is beyond end of dynamic array (%d) (size %d)", offset, _elementSize, _array.size());
-	_array[objectId] = value;
+	checkRange("writeByte", offset, 1);
+	_data[offset] = value;
 	return true;
 }
 
+void ScriptDynamicArray::zeroBytes(uint offset, uint count) {
+	if (_isManaged) {
+		// only whole pointers can be cleared
+		if (offset % 4 || count % 4 || (offset + count) / 4 > _objects.size())
+			error("zeroBytes: invalid range %d-%d for managed dynamic array (size %d)", offset, count, _objects.size());
+		for (uint i = offset / 4; i < (offset + count) / 4; ++i)
+			setObject(i * 4, NULL);
+		return;
+	}
+
+	checkRange("zeroBytes", offset, count);
+	if (count)
+		memset(&_data[offset], 0, count);
+}
+
+ScriptObject *ScriptDynamicArray::getObject(uint offset) {
+	assert(_isManaged);
+	assert(offset % 4 == 0);
+	uint32 objectId = offset / 4;
+	if (objectId >= _objects.size())
+		error("getObject: offset %d is beyond end of dynamic array (size %d)", offset, _objects.size());
+	return _objects[objectId];
+}
+
+void ScriptDynamicArray::setObject(uint offset, ScriptObject *object) {
+	assert(_isManaged);
+	assert(offset % 4 == 0);
+	uint32 objectId = offset / 4;
+	if (objectId >= _objects.size())
+		error("setObject: offset %d is beyond end of dynamic array (size %d)", offset, _objects.size());
+	if (object)
+		object->IncRef();
+	if (_objects[objectId])
+		_objects[objectId]->DecRef();
+	_objects[objectId] = object;
+}
+
 } // End of namespace AGS
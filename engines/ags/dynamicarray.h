@@ -46,13 +46,27 @@ public:
 	virtual byte readByte(uint offset);
 	virtual bool writeByte(uint offset, byte value);
 
+	// for ZEROMEMORY
+	void zeroBytes(uint offset, uint count);
+
+	// managed arrays hold (counted) references to objects
+	ScriptObject *getObject(uint offset);
+	void setObject(uint offset, ScriptObject *object);
+
+	bool isManaged() { return _isManaged; }
 	uint getMaxOffset() { return _elementSize * _elementCount; }
 
 protected:
 	bool _isManaged;
 	uint32 _elementSize;
 	uint32 _elementCount;
-	Common::Array<RuntimeValue> _array;
+
+	// raw little-endian element data (unmanaged arrays)
+	Common::Array<byte> _data;
+	// element pointers (managed arrays)
+	Common::Array<ScriptObject *> _objects;
+
+	void checkRange(const char *func, uint offset, uint count);
 };
 
 } // End of namespace AGS
@@ -25,6 +25,7 @@
  */
 
 #include "engines/ags/ags.h"
+#include "engines/ags/blit.h"
 #include "engines/ags/character.h"
 #include "engines/ags/constants.h"
 #include "engines/ags/drawable.h"
@@ -148,6 +149,10 @@ protected:
 class CursorDrawable : public Drawable {
 public:
 	CursorDrawable(AGSEngine *vm) : _vm(vm), _mouseFrame(0), _mouseDelay(0), _currentCursor(0xffffffff), _cursorSprite(NULL) { }
+	~CursorDrawable() {
+		if (_cursorSprite)
+			_vm->getSprites()->releaseSprite(_cursorSprite);
+	}
 
 	void setMouseCursor(uint32 cursor) {
 		assert(cursor < _vm->_gameFile->_cursors.size());
@@ -187,7 +192,11 @@ public:
 	}
 
 	void setCursorGraphic(uint32 spriteId) {
-		_cursorSprite = _vm->getSprites()->getSprite(spriteId);
+		// (acquired, since we keep hold of it)
+		Sprite *oldSprite = _cursorSprite;
+		_cursorSprite = _vm->getSprites()->acquireSprite(spriteId);
+		if (oldSprite)
+			_vm->getSprites()->releaseSprite(oldSprite);
 
 		if (!spriteId || !_cursorSprite) {
 			// FIXME
@@ -328,7 +337,8 @@ protected:
 };
 
 AGSGraphics::AGSGraphics(AGSEngine *vm) : _vm(vm), _width(0), _height(0), _forceLetterbox(false), _vsync(false),
-	_viewportX(0), _viewportY(0), _extraDrawable(NULL) {
+	_viewportX(0), _viewportY(0), _extraDrawable(NULL), _snowRainIndex(0), _fullRedrawNeeded(true),
+	_fullRedraw(true), _usedInternalDraw(false), _prevUsedInternalDraw(false) {
 
 	_cursorObj = new CursorDrawable(_vm);
 }
@@ -631,18 +641,21 @@ void AGSGraphics::draw() {
 	if (_vm->_gameFile->_colorDepth == 1)
 		g_system->getPaletteManager()->setPalette(_palette, 0, 256);
 
-	_backBuffer.fillRect(Common::Rect(0, 0, _backBuffer.w, _backBuffer.h), 0);
-
 	/*
 	 * This draws the screen. First, the current room background is drawn.
 	 * Then, room walkbehinds, objects and characters are drawn, sorted
 	 * by their baselines. After them come non-text overlays, then GUIs,
 	 * then text overlays, and finally the cursor.
+	 *
+	 * Everything is collected into a draw list first; comparing it with
+	 * the list from the previous frame tells us which areas of the screen
+	 * actually changed, and only those are redrawn and copied to the screen.
 	 */
 	Room *room = _vm->getCurrentRoom();
+	_drawList.clear();
 
 	// draw the current room background
-	draw(_vm->getCurrentRoom(), true);
+	addToDrawList(room, true);
 
 	// add the walkbehinds, objects and characters to an array, then sort it
 	Common::Array<Drawable *> drawables;
@@ -674,10 +687,10 @@ void AGSGraphics::draw() {
 	Common::sort(drawables.begin(), drawables.end(), DrawableLess());
 
 	for (uint i = 0; i < drawables.size(); ++i)
-		draw(drawables[i], true);
+		addToDrawList(drawables[i], true);
 
-	// TODO: make this suck less
-	drawSnowRain();
+	// snow/rain is drawn directly at this point, see internalDraw
+	_snowRainIndex = _drawList.size();
 
 	// draw overlays, except text boxes
 	for (uint i = 0; i < _vm->_overlays.size(); ++i) {
@@ -685,7 +698,7 @@ void AGSGraphics::draw() {
 			continue;
 
 		// FIXME: draw OVER_COMPLETE in non-transparent mode
-		draw(_vm->_overlays[i]);
+		addToDrawList(_vm->_overlays[i]);
 	}
 
 	bool guisTurnedOffAsDisabled = (_vm->_guiDisabledStyle == GUIDIS_GUIOFF) && _vm->_guiDisabledState;
@@ -697,7 +710,7 @@ void AGSGraphics::draw() {
 			continue;
 		if (guisTurnedOffAsDisabled && (group->_popup != POPUP_NOAUTOREM))
 			continue;
-		draw(group);
+		addToDrawList(group);
 	}
 
 	// draw text overlays (so that they appear over GUIs)
@@ -705,51 +718,182 @@ void AGSGraphics::draw() {
 		if (_vm->_overlays[i]->getType() != OVER_TEXTMSG)
 			continue;
 
-		draw(_vm->_overlays[i]);
+		addToDrawList(_vm->_overlays[i]);
 	}
 
 	if (_extraDrawable)
-		draw(_extraDrawable);
+		addToDrawList(_extraDrawable);
 
 	_cursorObj->tick();
 	if (!_vm->_state->_mouseCursorHidden)
-		draw(_cursorObj);
+		addToDrawList(_cursorObj);
+
+	// work out what needs redrawing; anything drawn behind our back
+	// last frame (i.e. snow/rain) means we have to start from scratch
+	_fullRedraw = _fullRedrawNeeded || _prevUsedInternalDraw;
+	if (!_fullRedraw)
+		findDirtyRects();
+	_fullRedrawNeeded = false;
+	_usedInternalDraw = false;
+
+	composite(0, _snowRainIndex);
+	// TODO: make this suck less
+	drawSnowRain();
+	composite(_snowRainIndex, _drawList.size());
 
 	// finally, update the screen
-	// FIXME: add dirty rectangling
-	g_system->copyRectToScreen((byte *)_backBuffer.getPixels(), _width * _vm->_gameFile->_colorDepth, 0, 0, _width, _height);
+	if (_fullRedraw) {
+		g_system->copyRectToScreen(_backBuffer.getPixels(), _backBuffer.pitch, 0, 0, _width, _height);
+	} else {
+		for (uint i = 0; i < _dirtyRects.size(); ++i) {
+			const Common::Rect &rect = _dirtyRects[i];
+			g_system->copyRectToScreen(_backBuffer.getBasePtr(rect.left, rect.top), _backBuffer.pitch,
+				rect.left, rect.top, rect.width(), rect.height());
+		}
+	}
 	g_system->updateScreen();
+
+	_prevDrawList = _drawList;
+	_prevUsedInternalDraw = _usedInternalDraw;
 }
 
 void AGSGraphics::internalDraw(const Graphics::Surface *srcSurf, const Common::Point &pos, uint transparency) {
+	if (!_fullRedraw) {
+		// we can't know what this covers, so redo everything below it
+		_fullRedraw = true;
+		composite(0, _snowRainIndex);
+	}
+	_usedInternalDraw = true;
+
 	blit(srcSurf, &_backBuffer, pos, transparency);
 }
 
-void AGSGraphics::draw(Drawable *item, bool useViewport) {
-	uint transparency = item->getDrawTransparency();
+bool AGSGraphics::DrawRecord::operator==(const DrawRecord &other) const {
+	return id == other.id && surface == other.surface && pixels == other.pixels && pos == other.pos
+		&& area == other.area && transparency == other.transparency && mirrored == other.mirrored
+		&& generation == other.generation;
+}
 
-	Common::Point pos = item->getDrawPos();
+void AGSGraphics::addToDrawList(Drawable *item, bool useViewport) {
+	DrawRecord record;
+	record.item = item;
+	record.id = item->getDrawId();
+	record.transparency = item->getDrawTransparency();
+	// fully transparent items never touch the screen
+	if (record.transparency == 255)
+		return;
+
+	record.pos = item->getDrawPos();
 	if (useViewport)
-		pos -= Common::Point(_viewportX, _viewportY);
+		record.pos -= Common::Point(_viewportX, _viewportY);
 	uint itemWidth = item->getDrawWidth();
 	uint itemHeight = item->getDrawHeight();
 	if (!itemWidth || !itemHeight)
 		return;
-	bool mirrored = item->isDrawMirrored();
-	const Graphics::Surface *surface = item->getDrawSurface();
+	record.mirrored = item->isDrawMirrored();
+	record.surface = item->getDrawSurface();
+	// (must come after getDrawSurface, which may redraw)
+	record.generation = item->getDrawGeneration();
+	record.pixels = record.surface->getPixels();
 
 	// FIXME: lots of things
-	blit(surface, &_backBuffer, pos, transparency, mirrored);
+	record.area = Common::Rect(record.pos.x, record.pos.y,
+		record.pos.x + record.surface->w, record.pos.y + record.surface->h);
+
+	_drawList.push_back(record);
+}
+
+void AGSGraphics::forgetSurface(const Graphics::Surface *surface) {
+	// make sure whatever ends up at the same address doesn't look unchanged
+	for (uint i = 0; i < _prevDrawList.size(); ++i) {
+		if (_prevDrawList[i].surface != surface)
+			continue;
+		_prevDrawList[i].surface = NULL;
+		_prevDrawList[i].pixels = NULL;
+	}
+}
+
+void AGSGraphics::addDirtyRect(Common::Rect rect) {
+	rect.clip(_width, _height);
+	if (rect.isEmpty())
+		return;
+
+	// merge with anything we overlap (which may in turn overlap other rects)
+	for (uint i = 0; i < _dirtyRects.size(); ) {
+		if (!_dirtyRects[i].intersects(rect)) {
+			++i;
+			continue;
+		}
+
+		rect.extend(_dirtyRects[i]);
+		_dirtyRects.remove_at(i);
+		i = 0;
+	}
+
+	_dirtyRects.push_back(rect);
+}
+
+void AGSGraphics::findDirtyRects() {
+	_dirtyRects.clear();
+
+	// a pixel only needs redrawing if one of the records covering it
+	// changed; records are compared in draw order, so a change in the
+	// order also causes everything involved to be redrawn
+	uint count = MAX(_drawList.size(), _prevDrawList.size());
+	for (uint i = 0; i < count; ++i) {
+		bool inNew = (i < _drawList.size());
+		bool inOld = (i < _prevDrawList.size());
+		if (inNew && inOld && _drawList[i] == _prevDrawList[i])
+			continue;
+
+		if (inOld)
+			addDirtyRect(_prevDrawList[i].area);
+		if (inNew)
+			addDirtyRect(_drawList[i].area);
+	}
+
+	// past a point, one big copy is cheaper than lots of little ones
+	uint dirtyArea = 0;
+	for (uint i = 0; i < _dirtyRects.size(); ++i)
+		dirtyArea += _dirtyRects[i].width() * _dirtyRects[i].height();
+	if (dirtyArea * 2 > (uint)_width * _height)
+		_fullRedraw = true;
+}
+
+void AGSGraphics::composite(uint first, uint last) {
+	if (_fullRedraw) {
+		if (!first)
+			_backBuffer.fillRect(Common::Rect(0, 0, _backBuffer.w, _backBuffer.h), 0);
+		for (uint i = first; i < last; ++i) {
+			const DrawRecord &record = _drawList[i];
+			blit(record.surface, &_backBuffer, record.pos, record.transparency, record.mirrored);
+		}
+		return;
+	}
 
+	for (uint j = 0; j < _dirtyRects.size(); ++j) {
+		const Common::Rect &rect = _dirtyRects[j];
+		Graphics::Surface dest = _backBuffer.getSubArea(rect);
+		if (!first)
+			dest.fillRect(Common::Rect(0, 0, dest.w, dest.h), 0);
+
+		for (uint i = first; i < last; ++i) {
+			const DrawRecord &record = _drawList[i];
+			if (!record.area.intersects(rect))
+				continue;
+			blit(record.surface, &dest, record.pos - Common::Point(rect.left, rect.top),
+				record.transparency, record.mirrored);
+		}
+	}
 }
 
 static bool blitClip(Common::Point &pos, const Graphics::Surface *srcSurf, Graphics::Surface *destSurf, bool mirrored, uint &startX, uint &startY, uint &width, uint &height) {
 	// FIXME: make sure the mirrored parts are ok
 
 	// ignore surfaces which are entirely off-screen
-	if (pos.x > destSurf->w)
+	if (pos.x >= destSurf->w)
 		return true;
-	if (pos.y > destSurf->h)
+	if (pos.y >= destSurf->h)
 		return true;
 
 	width = srcSurf->w;
@@ -759,7 +903,7 @@ static bool blitClip(Common::Point &pos, const Graphics::Surface *srcSurf, Graph
 	// because some of it is off-screen
 	startX = 0;
 	if (pos.x < 0) {
-		if ((uint)-pos.x > srcSurf->w)
+		if ((uint)-pos.x >= srcSurf->w)
 			return true;
 
 		if (mirrored) {
@@ -777,7 +921,7 @@ static bool blitClip(Common::Point &pos, const Graphics::Surface *srcSurf, Graph
 	if (pos.y < 0) {
 		// we only want to draw the bottom half
 		startY = -pos.y;
-		if (startY > srcSurf->h)
+		if (startY >= srcSurf->h)
 			return true;
 		pos.y = 0;
 		height -= startY;
@@ -807,165 +951,30 @@ void AGSGraphics::blit(const Graphics::Surface *srcSurf, Graphics::Surface *dest
 	if (blitClip(pos, srcSurf, destSurf, mirrored, startX, startY, width, height))
 		return;
 
-	if (srcSurf->format.bytesPerPixel == 1) {
-		for (uint y = 0; y < height; ++y) {
-			byte *dest;
-			if (mirrored)
-				dest = (byte *)destSurf->getBasePtr(pos.x + width, pos.y + y);
-			else
-				dest = (byte *)destSurf->getBasePtr(pos.x, pos.y + y);
-			const byte *src = (const byte *)srcSurf->getBasePtr(startX, startY + y);
-			for (uint x = 0; x < width; ++x) {
-				byte data = *src++;
-				if (data != 0)
-					*dest = data;
-				if (mirrored)
-					dest--;
-				else
-					dest++;
-			}
-		}
-	} else if (srcSurf->format.bytesPerPixel == 2) {
-		uint16 transColor = (uint16)getTransparentColor();
-
-		if (!transparency) {
-			// simplified version of the loop below for the transparent==0 (opaque) case
-			for (uint y = 0; y < height; ++y) {
-				uint16 *dest;
-				if (mirrored)
-					dest = (uint16 *)destSurf->getBasePtr(pos.x + width, pos.y + y);
-				else
-					dest = (uint16 *)destSurf->getBasePtr(pos.x, pos.y + y);
-				const uint16 *src = (const uint16 *)srcSurf->getBasePtr(startX, startY + y);
-				for (uint x = 0; x < width; ++x) {
-					uint16 srcData = *src++;
-					if (srcData != transColor)
-						*dest = srcData;
-					if (mirrored)
-						dest--;
-					else
-						dest++;
-				}
-			}
-			return;
-		}
-
-		transparency = (transparency + 1) / 8;
-
-		for (uint y = 0; y < height; ++y) {
-			uint16 *dest;
-			if (mirrored)
-				dest = (uint16 *)destSurf->getBasePtr(pos.x + width, pos.y + y);
-			else
-				dest = (uint16 *)destSurf->getBasePtr(pos.x, pos.y + y);
-			const uint16 *src = (const uint16 *)srcSurf->getBasePtr(startX, startY + y);
-			for (uint x = 0; x < width; ++x) {
-				uint16 srcData = *src++;
-				if (srcData != transColor) {
-					uint16 destData = *dest;
-
-					uint32 blendDest = (destData | (destData << 16)) & 0x7E0F81F;
-					uint32 blendSrc = (srcData | (srcData << 16)) & 0x7E0F81F;
-					uint32 blended = (blendSrc - blendDest) * transparency / 32 + blendDest;
-					blended &= 0x7E0F81F;
-					*dest = (blended & 0xFFFF) | (blended >> 16);
-				}
-				if (mirrored)
-					dest--;
-				else
-					dest++;
-			}
+	// work out how to draw this once, rather than for every pixel
+	BlitMode mode = kBlitKeyed;
+	uint32 key = 0;
+	uint alpha = 0;
+	if (srcSurf->format.bytesPerPixel == 2) {
+		key = (uint16)getTransparentColor();
+		if (transparency) {
+			mode = kBlitBlend;
+			alpha = (transparency + 1) / 8;
 		}
-	} else {
-		uint32 transColor = (uint32)getTransparentColor();
-
+	} else if (srcSurf->format.bytesPerPixel == 4) {
+		key = (uint32)getTransparentColor();
 		if (srcSurf->format.aShift) {
-			for (uint y = 0; y < height; ++y) {
-				uint32 *dest;
-				if (mirrored)
-					dest = (uint32 *)destSurf->getBasePtr(pos.x + width, pos.y + y);
-				else
-					dest = (uint32 *)destSurf->getBasePtr(pos.x, pos.y + y);
-				const uint32 *src = (const uint32 *)srcSurf->getBasePtr(startX, startY + y);
-				for (uint x = 0; x < width; ++x) {
-					uint32 srcData = *src++;
-					if ((srcData & 0xffffff) != transColor) {
-						uint32 destData = *dest;
-
-						transparency = srcData >> 24;
-						if (destSurf->format.aShift) {
-							// alpha onto alpha; additive
-							uint alpha = MIN<uint>(0xff, transparency + (destData >> 24));
-							*dest = (alpha << 24) | (srcData & 0xffffff);
-						} else {
-							// alpha onto non-alpha; blend
-							if (transparency)
-								transparency++;
-							uint32 blendedRB = ((srcData & 0xFF00FF) - (destData & 0xFF00FF))
-								* transparency / 256 + (destData & 0xFF00FF);
-							uint32 blended = ((srcData & 0xFF00) - (destData & 0xFF00))
-								* transparency / 256 + (destData & 0xFF00);
-							*dest = (blended & 0xFF00) | (blendedRB & 0xFF00FF) | 0xFF000000;
-						}
-					}
-					if (mirrored)
-						dest--;
-					else
-						dest++;
-				}
-			}
-			return;
-		}
-
-		if (!transparency) {
-			// simplified version of the loop below for the transparent==0 (opaque) case
-			for (uint y = 0; y < height; ++y) {
-				uint32 *dest;
-				if (mirrored)
-					dest = (uint32 *)destSurf->getBasePtr(pos.x + width, pos.y + y);
-				else
-					dest = (uint32 *)destSurf->getBasePtr(pos.x, pos.y + y);
-				const uint32 *src = (const uint32 *)srcSurf->getBasePtr(startX, startY + y);
-				for (uint x = 0; x < width; ++x) {
-					uint32 srcData = *src++;
-					if ((srcData & 0xffffff) != transColor)
-						*dest = srcData | 0xff000000;
-					if (mirrored)
-						dest--;
-					else
-						dest++;
-				}
-			}
-			return;
-		}
-
-		transparency = transparency + 1;
-
-		for (uint y = 0; y < height; ++y) {
-			uint32 *dest;
-			if (mirrored)
-				dest = (uint32 *)destSurf->getBasePtr(pos.x + width, pos.y + y);
-			else
-				dest = (uint32 *)destSurf->getBasePtr(pos.x, pos.y + y);
-			const uint32 *src = (const uint32 *)srcSurf->getBasePtr(startX, startY + y);
-			for (uint x = 0; x < width; ++x) {
-				uint32 srcData = *src++;
-				if ((srcData & 0xffffff) != transColor) {
-					uint32 destData = *dest;
-
-					uint32 blendedRB = ((srcData & 0xFF00FF) - (destData & 0xFF00FF))
-						* transparency / 256 + destData;
-					uint32 blended = ((srcData & 0xFF00) - (destData & 0xFF00))
-						* transparency / 256 + (destData & 0xFF00);
-					*dest = (blended & 0xFF00) | (blendedRB & 0xFF00FF) | 0xFF000000;
-				}
-				if (mirrored)
-					dest--;
-				else
-					dest++;
-			}
+			// alpha onto alpha is additive, alpha onto non-alpha blends
+			mode = destSurf->format.aShift ? kBlitAlphaAdd : kBlitAlphaBlend;
+		} else if (transparency) {
+			mode = kBlitBlend;
+			alpha = transparency + 1;
 		}
 	}
+	BlitRowFunc blitRow = getBlitRowFunc(mode, srcSurf->format.bytesPerPixel, mirrored);
+
+	for (uint y = 0; y < height; ++y)
+		blitRow(destSurf->getBasePtr(pos.x, pos.y + y), srcSurf->getBasePtr(startX, startY + y), width, key, alpha);
 }
 
 void AGSGraphics::setMouseCursor(uint32 cursor) {
@@ -1001,7 +1010,9 @@ void AGSGraphics::checkViewportCoords() {
 		_viewportY = roomHeight - _height;
 }
 
-Drawable::Drawable() {
+static uint s_nextDrawId = 0;
+
+Drawable::Drawable() : _drawId(s_nextDrawId++), _drawGeneration(0) {
 }
 
 Drawable::~Drawable() {
@@ -27,6 +27,7 @@
 #ifndef AGS_GRAPHICS_H
 #define AGS_GRAPHICS_H
 
+#include "common/array.h"
 #include "common/rect.h"
 #include "graphics/surface.h"
 
@@ -66,6 +67,10 @@ public:
 	void drawOutlinedString(uint fontId, Graphics::Surface *surface, const Common::String &text, int x, int y, uint width, uint32 color);
 
 	void draw();
+	// forces the whole screen to be redrawn on the next frame
+	void invalidateAll() { _fullRedrawNeeded = true; }
+	// called before a surface is freed, since a new one may reuse its memory
+	void forgetSurface(const Graphics::Surface *surface);
 
 	// TODO: fix this (hack for SnowRain)
 	void internalDraw(const Graphics::Surface *srcSurf, const Common::Point &pos, uint transparency);
@@ -73,7 +78,7 @@ public:
 	void blit(const Graphics::Surface *srcSurf, Graphics::Surface *destSurf, Common::Point pos, uint transparency,
 		bool mirrored = false);
 
-	void setExtraDrawable(Drawable *drawable) { _extraDrawable = drawable; }
+	void setExtraDrawable(Drawable *drawable) { _extraDrawable = drawable; invalidateAll(); }
 
 	void setMouseCursor(uint32 cursor);
 	void mouseSetHotspot(uint32 x, uint32 y);
@@ -104,7 +109,31 @@ protected:
 
 	Common::Array<Graphics::Font *> _fonts;
 
-	void draw(Drawable *item, bool useViewport = false);
+	// everything which was drawn in a frame, in drawing order
+	struct DrawRecord {
+		Drawable *item;
+		uint id;
+		const Graphics::Surface *surface;
+		const void *pixels;
+		Common::Point pos;
+		uint transparency;
+		bool mirrored;
+		uint generation;
+		Common::Rect area;
+
+		bool operator==(const DrawRecord &other) const;
+	};
+
+	Common::Array<DrawRecord> _drawList, _prevDrawList;
+	uint _snowRainIndex;
+	Common::Array<Common::Rect> _dirtyRects;
+	bool _fullRedrawNeeded, _fullRedraw;
+	bool _usedInternalDraw, _prevUsedInternalDraw;
+
+	void addToDrawList(Drawable *item, bool useViewport = false);
+	void addDirtyRect(Common::Rect rect);
+	void findDirtyRects();
+	void composite(uint first, uint last);
 
 	class CursorDrawable *_cursorObj;
 
@@ -1326,6 +1326,7 @@ void GUIGroup::draw() {
 	}
 
 	_needsUpdate = false;
+	drawSurfaceChanged();
 }
 
 struct GUIZOrderLess {
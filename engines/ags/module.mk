@@ -3,6 +3,7 @@ MODULE := engines/ags
 MODULE_OBJS := \
 	ags.o \
 	audio.o \
+	blit.o \
 	character.o \
 	detection.o \
 	dialog.o \
@@ -17,6 +18,7 @@ MODULE_OBJS := \
 	resourceman.o \
 	room.o \
 	script.o \
+	scriptprofiler.o \
 	scripting/audio.o \
 	scripting/character.o \
 	scripting/dialog.o \
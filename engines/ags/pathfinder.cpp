@@ -29,7 +29,6 @@
 #include "engines/ags/constants.h"
 #include "engines/ags/gamefile.h"
 #include "engines/ags/graphics.h"
-#include "common/queue.h"
 #include "graphics/surface.h"
 
 namespace AGS {
@@ -154,28 +153,36 @@ struct PathFinder {
 	// the destination (possibly adjusted)
 	Common::Point _dest;
 
-	// internal pathfinding state
-	Graphics::Surface _beenHere;
-	Common::Array<int> _walkAreaGranularity;
+	// the connectivity of the mask
+	const WalkableAreaInfo *_areaInfo;
+
 
 	bool _hasFinalStep;
 	Common::Point _finalStep;
 
 	// state needed to construct the final path
 	Common::Array<Common::Point> _pathBackPositions;
+	// did we search for a route (which should be cached once it's constructed)?
+	bool _routeSearched;
 
 	bool findPath(bool onlyIfDestAllowed);
 
 	bool constructPath();
+	void cacheRoute();
 
 protected:
 	Common::Point roundDownCoordinates(Common::Point pos);
 	bool isRoutePossible(bool &foundNewCandidate);
-	bool findRouteDijkstra();
+	bool findRouteAStar();
+	bool findCachedRoute();
+	void addRoute(uint32 node, bool reversed);
 	bool tryThisSquare(const Common::Point &from, const Common::Point &to, bool goingRight);
 
-	bool dijkstraCheckNeighbor(uint x, uint y, uint nX, uint nY, int modifier, int &min, Common::Array<uint> &found, Common::Array<uint> &cheapest);
-	bool findNearestWalkableArea(const Graphics::Surface &tempMask, int startX, int startY, int endX, int endY, uint step);
+	bool findNearestWalkableArea(uint16 label, int startX, int startY, int endX, int endY, uint step);
+
+	friend void findPaths(AGSEngine *, const Graphics::Surface *, const WalkableAreaInfo *, Common::Array<PathRequest> &);
+	bool isNear(int x, int y, const Common::Point &target) const;
+	void searchRoutes(const Common::Point &from, const Common::Array<Common::Point> &targets, Common::Array<uint32> &reached);
 };
 
 bool PathFinder::findPath(bool onlyIfDestAllowed) {
@@ -201,18 +208,16 @@ bool PathFinder::findPath(bool onlyIfDestAllowed) {
 		return true;
 
 	// TODO: this is annotated "don't use new algo on arrow key presses", maybe be smarter for that use case..
-	//if (!isStraight && findRouteDijkstra())
-	if (findRouteDijkstra())
+	//if (!isStraight && findRouteAStar())
+	if (findRouteAStar())
 		return true;
 
 	// if the new pathfinder failed, try the old one..
 	_pathBackPositions.clear();
-	memset(_beenHere.getPixels(), 0, _beenHere.w * _beenHere.h * 2);
 	if (tryThisSquare(from, _dest, true))
 		return true;
 	// .. and again, in the other direction.
 	_pathBackPositions.clear();
-	memset(_beenHere.getPixels(), 0, _beenHere.w * _beenHere.h * 2);
 	if (tryThisSquare(from, _dest, false))
 		return true;
 
@@ -220,17 +225,17 @@ bool PathFinder::findPath(bool onlyIfDestAllowed) {
 	return false;
 }
 
-bool PathFinder::findNearestWalkableArea(const Graphics::Surface &tempMask, int startX, int startY, int endX, int endY, uint step) {
+bool PathFinder::findNearestWalkableArea(uint16 label, int startX, int startY, int endX, int endY, uint step) {
 	startX = MAX<int>(0, startX);
 	startY = MAX<int>(0, startY);
-	endX = MIN<int>(endX, tempMask.w - 1);
-	endY = MIN<int>(endY, tempMask.h - 1);
+	endX = MIN<int>(endX, _areaInfo->_width - 1);
+	endY = MIN<int>(endY, _areaInfo->_height - 1);
 
 	uint nearest = 99999;
 	Common::Point best;
 	for (int x = startX; x < endX; x += step) {
 		for (int y = startY; y < endY; y += step) {
-			if (*(const byte *)tempMask.getBasePtr(x, y) != 232)
+			if (_areaInfo->getLabel(x, y) != label)
 				continue;
 
 			uint distance = (uint)sqrt((x - _dest.x) * (x - _dest.x) + (y - _dest.y) * (y - _dest.y));
@@ -248,55 +253,29 @@ bool PathFinder::findNearestWalkableArea(const Graphics::Surface &tempMask, int
 	return true;
 }
 
-static void floodFill(Graphics::Surface &surf, uint x, uint y, byte color) {
-	// TODO: Make this more efficient.
-
-	byte replace = *(byte *)surf.getBasePtr(x, y);
-	assert(replace != color);
-
-	Common::Queue<Common::Point> _queue;
-	_queue.push(Common::Point(x, y));
-
-	while (!_queue.empty()) {
-		Common::Point point = _queue.pop();
-		x = point.x;
-		y = point.y;
-		if (*(byte *)surf.getBasePtr(x, y) == color)
-			continue;
-		*(byte *)surf.getBasePtr(x, y) = color;
+const int MAX_GRANULARITY = 3;
 
-		if (x > 0 && *(byte *)surf.getBasePtr(x - 1, y) == replace)
-			_queue.push(Common::Point(x - 1, y));
-		if (x + 1 < surf.w && *(byte *)surf.getBasePtr(x + 1, y) == replace)
-			_queue.push(Common::Point(x + 1, y));
-		if (y > 0 && *(byte *)surf.getBasePtr(x, y - 1) == replace)
-			_queue.push(Common::Point(x, y - 1));
-		if (y + 1 < surf.h && *(byte *)surf.getBasePtr(x, y + 1) == replace)
-			_queue.push(Common::Point(x, y + 1));
-	}
+void WalkableAreaInfo::clear() {
+	_width = _height = 0;
+	_labels.clear();
+	_searchNodes.clear();
+	_openNodes.clear();
+	_pathCache.clear();
 }
 
-const int MAX_GRANULARITY = 3;
-
-// First, prepare our internal temporary walkable mask. Then, check if there's
-// a possible path, by flood-filling from the source and making sure the
-// destination gets filled. If it doesn't, try finding a nearby point which was.
-bool PathFinder::isRoutePossible(bool &foundNewCandidate) {
-	foundNewCandidate = false;
+void WalkableAreaInfo::calculate(const Graphics::Surface &mask, uint32 generation) {
+	assert(mask.format.bytesPerPixel == 1);
 
-	// If we're not *starting* from a walkable position, this will never work.
-	if (*(const byte *)_mask->getBasePtr(_moveList->_from.x, _moveList->_from.y) == 0) {
-		warning("refusing to route from unwalkable point %d,%d", _moveList->_from.x, _moveList->_from.y);
-		return false;
-	}
+	_width = mask.w;
+	_height = mask.h;
 
-	Graphics::Surface tempMask;
-	tempMask.copyFrom(*_mask);
+	// any cached routes are no longer valid
+	_generation = generation;
+	_pathCache.clear();
 
-	_walkAreaGranularity.resize(MAX_WALK_AREAS + 1);
-	uint walkAreaTimes[MAX_WALK_AREAS + 1];
+	int walkAreaTimes[MAX_WALK_AREAS + 1];
 	for (uint i = 0; i < MAX_WALK_AREAS + 1; ++i) {
-		_walkAreaGranularity[i] = 0;
+		_granularity[i] = 0;
 		walkAreaTimes[i] = 0;
 	}
 
@@ -304,30 +283,28 @@ bool PathFinder::isRoutePossible(bool &foundNewCandidate) {
 	// TODO: shouldn't this really stop at the end of each row/column? and reset between orientations?
 	uint prevAreaType = 0;
 	uint inARow = 0;
-	for (uint y = 0; y < tempMask.h; ++y) {
-		for (uint x = 0; x < tempMask.w; ++x) {
-			uint areaType = *(byte *)tempMask.getBasePtr(x, y);
+	for (uint y = 0; y < _height; ++y) {
+		const byte *ptr = (const byte *)mask.getBasePtr(0, y);
+		for (uint x = 0; x < _width; ++x) {
+			uint areaType = ptr[x];
 			// TODO: verify the walkable mask before we get here, error check here would be silly
 			if (areaType == prevAreaType && inARow > 0)
 				inARow++;
 			else if (prevAreaType != 0) {
-				_walkAreaGranularity[prevAreaType] += inARow;
+				_granularity[prevAreaType] += inARow;
 				walkAreaTimes[prevAreaType]++;
 				inARow = 0;
 			}
 			prevAreaType = areaType;
 		}
 	}
-	for (uint x = 0; x < tempMask.w; ++x) {
-		for (uint y = 0; y < tempMask.h; ++y) {
-			uint areaType = *(byte *)tempMask.getBasePtr(x, y);
-			// overwrite the walkable areas with a uniform color
-			if (areaType)
-				*(byte *)tempMask.getBasePtr(x, y) = 1;
+	for (uint x = 0; x < _width; ++x) {
+		for (uint y = 0; y < _height; ++y) {
+			uint areaType = *(const byte *)mask.getBasePtr(x, y);
 			if (areaType == prevAreaType && inARow > 0)
 				inARow++;
 			else if (prevAreaType != 0) {
-				_walkAreaGranularity[prevAreaType] += inARow;
+				_granularity[prevAreaType] += inARow;
 				walkAreaTimes[prevAreaType]++;
 				inARow = 0;
 			}
@@ -336,27 +313,90 @@ bool PathFinder::isRoutePossible(bool &foundNewCandidate) {
 	}
 
 	// find the average "width" of a path in this walkable area
-	_walkAreaGranularity[0] = MAX_GRANULARITY;
+	_granularity[0] = MAX_GRANULARITY;
 	for (uint i = 1; i <= MAX_WALK_AREAS; ++i) {
 		if (!walkAreaTimes[i]) {
 			// We didn't encounter *any* (useful) walkable areas of this type.
-			_walkAreaGranularity[i] = MAX_GRANULARITY;
+			_granularity[i] = MAX_GRANULARITY;
 			continue;
 		}
 
-		_walkAreaGranularity[i] /= walkAreaTimes[i];
-		if (_walkAreaGranularity[i] <= 4)
-			_walkAreaGranularity[i] = 2;
-		else if (_walkAreaGranularity[i] <= 15)
-			_walkAreaGranularity[i] = 3;
+		_granularity[i] /= walkAreaTimes[i];
+		if (_granularity[i] <= 4)
+			_granularity[i] = 2;
+		else if (_granularity[i] <= 15)
+			_granularity[i] = 3;
 		else
-			_walkAreaGranularity[i] = MAX_GRANULARITY;
+			_granularity[i] = MAX_GRANULARITY;
+	}
+
+	// label the connected parts of the mask (all walkable areas count as the
+	// same), by flood-filling from each walkable pixel which isn't labelled yet
+	_labels.resize(_width * _height);
+	if (_labels.empty())
+		return;
+	memset(&_labels[0], 0, _labels.size() * sizeof(uint16));
+
+	uint16 nextLabel = 1;
+	Common::Array<uint32> stack;
+	for (uint y = 0; y < _height; ++y) {
+		const byte *ptr = (const byte *)mask.getBasePtr(0, y);
+		for (uint x = 0; x < _width; ++x) {
+			if (!ptr[x] || _labels[y * _width + x])
+				continue;
+
+			uint16 label = nextLabel;
+			// (only pathological masks could have this many; the pathfinder
+			// itself still fails if the parts sharing the last label aren't connected)
+			if (nextLabel != 0xffff)
+				nextLabel++;
+
+			_labels[y * _width + x] = label;
+			stack.push_back(y * _width + x);
+			while (!stack.empty()) {
+				uint32 pos = stack.back();
+				stack.pop_back();
+				uint px = pos % _width, py = pos / _width;
+
+				if (px > 0 && !_labels[pos - 1] && *(const byte *)mask.getBasePtr(px - 1, py)) {
+					_labels[pos - 1] = label;
+					stack.push_back(pos - 1);
+				}
+				if (px + 1 < _width && !_labels[pos + 1] && *(const byte *)mask.getBasePtr(px + 1, py)) {
+					_labels[pos + 1] = label;
+					stack.push_back(pos + 1);
+				}
+				if (py > 0 && !_labels[pos - _width] && *(const byte *)mask.getBasePtr(px, py - 1)) {
+					_labels[pos - _width] = label;
+					stack.push_back(pos - _width);
+				}
+				if (py + 1 < _height && !_labels[pos + _width] && *(const byte *)mask.getBasePtr(px, py + 1)) {
+					_labels[pos + _width] = label;
+					stack.push_back(pos + _width);
+				}
+			}
+		}
+	}
+
+	debug(4, "walkable mask has %d connected parts", nextLabel - 1);
+}
+
+// Check if there's a possible path, by making sure the source and
+// destination are in the same connected part of the mask. If they
+// aren't, try finding a nearby point which is.
+bool PathFinder::isRoutePossible(bool &foundNewCandidate) {
+	foundNewCandidate = false;
+
+	// If we're not *starting* from a walkable position, this will never work.
+	if (*(const byte *)_mask->getBasePtr(_moveList->_from.x, _moveList->_from.y) == 0) {
+		warning("refusing to route from unwalkable point %d,%d", _moveList->_from.x, _moveList->_from.y);
+		return false;
 	}
 
 	bool found = true;
 
-	floodFill(tempMask, _moveList->_from.x, _moveList->_from.y, 232);
-	if (*(byte *)tempMask.getBasePtr(_dest.x, _dest.y) != 232) {
+	uint16 label = _areaInfo->getLabel(_moveList->_from.x, _moveList->_from.y);
+	if (_areaInfo->getLabel(_dest.x, _dest.y) != label) {
 		// destination pixel is not reachable
 		found = false;
 		foundNewCandidate = true;
@@ -364,9 +404,9 @@ bool PathFinder::isRoutePossible(bool &foundNewCandidate) {
 		warning("%d, %d not reachable", _dest.x, _dest.y);
 
 		// try 100x100 square around the target, at 3-pixel granularity
-		if (!findNearestWalkableArea(tempMask, _dest.x - 50, _dest.y - 50, _dest.x + 50, _dest.y + 50, 3)) {
+		if (!findNearestWalkableArea(label, _dest.x - 50, _dest.y - 50, _dest.x + 50, _dest.y + 50, 3)) {
 			// then sweep the whole room at 5-pixel granularity
-			if (!findNearestWalkableArea(tempMask, 0, 0, tempMask.w, tempMask.h, 5))
+			if (!findNearestWalkableArea(label, 0, 0, _areaInfo->_width, _areaInfo->_height, 5))
 				foundNewCandidate = false;
 		}
 
@@ -374,14 +414,13 @@ bool PathFinder::isRoutePossible(bool &foundNewCandidate) {
 			warning("now using %d, %d", _dest.x, _dest.y);
 	}
 
-	tempMask.free();
 	return found;
 }
 
 // Round down the supplied co-ordinates to the area granularity,
 // and move a bit if this causes them to become non-walkable
 Common::Point PathFinder::roundDownCoordinates(Common::Point pos) {
-	int startGranularity = _walkAreaGranularity[*(const byte *)_mask->getBasePtr(pos.x, pos.y)];
+	int startGranularity = _areaInfo->_granularity[*(const byte *)_mask->getBasePtr(pos.x, pos.y)];
 
 	pos.y = pos.y - pos.y % startGranularity;
 	if (pos.y < 0)
@@ -403,206 +442,313 @@ Common::Point PathFinder::roundDownCoordinates(Common::Point pos) {
 	return pos;
 }
 
-// replaces the 'CHECK_MIN' macro in the original:
-// Update our state to account for the specified cell and adjacent neighbor,
-// and return true if we bothered making the check.
-bool PathFinder::dijkstraCheckNeighbor(uint x, uint y, uint nX, uint nY, int modifier, int &min, Common::Array<uint> &found, Common::Array<uint> &cheapest) {
-	// Neighbor finished already?
-	if (*(const int16 *)_beenHere.getBasePtr(nX, nY) != -1)
-		return false;
+// costs of a straight and a diagonal step of one pixel
+const uint STRAIGHT_COST = 10;
+const uint DIAGONAL_COST = 14;
 
-	// Neighbor not walkable?
-	if (*(const byte *)_mask->getBasePtr(nX, nY) == 0)
-		return true;
-
-	// Cost of the cell?
-	int ourValue = *(int16 *)_beenHere.getBasePtr(x, y) + modifier;
-
-	// More expensive than what we already saw?
-	if (ourValue > min)
-		return true;
+// octile distance: the cost of the best path if nothing was in the way
+static uint estimateCost(int x1, int y1, int x2, int y2) {
+	uint dx = ABS(x1 - x2);
+	uint dy = ABS(y1 - y2);
+	return STRAIGHT_COST * MAX(dx, dy) + (DIAGONAL_COST - STRAIGHT_COST) * MIN(dx, dy);
+}
 
-	if (ourValue < min) {
-		// New minimum path length found. Clear any found nodes.
-		min = ourValue;
-		found.clear();
-		cheapest.clear();
+// the open set is a binary min-heap, ordered by estimated total cost
+struct OpenNodeGreater {
+	bool operator()(const WalkableAreaInfo::OpenNode &a, const WalkableAreaInfo::OpenNode &b) const {
+		return a._estimate > b._estimate;
 	}
+};
 
-	// TODO: Agh, this is actually necessary, otherwise it spends forever checking the same cells.
-	if (found.size() >= 40)
-		return true;
-
-	// Add the neighbor and cell to the lists, if we're the cheapest path to it so far.
-	found.push_back(nX + (nY * _beenHere.w));
-	cheapest.push_back(x + (y * _beenHere.w));
-
-	return true;
+static void pushOpenNode(Common::Array<WalkableAreaInfo::OpenNode> &heap, const WalkableAreaInfo::OpenNode &node) {
+	OpenNodeGreater greater;
+	uint i = heap.size();
+	heap.push_back(node);
+	while (i > 0) {
+		uint parent = (i - 1) / 2;
+		if (!greater(heap[parent], node))
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = node;
 }
 
-// Try to find a route using A*.
-bool PathFinder::findRouteDijkstra() {
-	Common::Point from = roundDownCoordinates(_moveList->_from);
-
-	// already at destination, once adjusted?
-	if (from == roundDownCoordinates(_dest))
-		return true;
-
-	memset(_beenHere.getPixels(), 0xff, _beenHere.w * _beenHere.h * 2);
-	*(int16 *)_beenHere.getBasePtr(from.x, from.y) = 0;
-
-	// We store the previously-visited 'parent' cells here, for later tracing back.
-	Graphics::Surface parent;
-	parent.create(_beenHere.w, _beenHere.h, Graphics::PixelFormat(4, 0, 0, 0, 0, 0, 0, 0, 0));
-	uint *parentVals = (uint *)parent.getPixels();
+static WalkableAreaInfo::OpenNode popOpenNode(Common::Array<WalkableAreaInfo::OpenNode> &heap) {
+	OpenNodeGreater greater;
+	WalkableAreaInfo::OpenNode top = heap[0];
+	WalkableAreaInfo::OpenNode last = heap.back();
+	heap.pop_back();
+
+	uint size = heap.size();
+	uint i = 0;
+	while (size) {
+		uint child = i * 2 + 1;
+		if (child >= size)
+			break;
+		if (child + 1 < size && greater(heap[child], heap[child + 1]))
+			child++;
+		if (!greater(last, heap[child]))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	if (size)
+		heap[i] = last;
 
-	// This is a list of the visited cell positions, in order.
-	uint visited[5000];
-	visited[0] = (from.y * parent.w) + from.x;
-	parentVals[visited[0]] = (uint)-1;
+	return top;
+}
 
-	uint iteration = 1;
-	uint totalFound = 0;
-	int directionBonus = 0;
+// Is this position close enough to the target to count as being there?
+bool PathFinder::isNear(int x, int y, const Common::Point &target) const {
+	// The edges of the screen pose a problem, so if the current position
+	// and the target are both within a certain distance of the edge,
+	// just snap to the target.
+	if ((x >= _mask->w - MAX_GRANULARITY) && (target.x >= _mask->w - MAX_GRANULARITY))
+		x = target.x;
+	if ((y >= _mask->h - MAX_GRANULARITY) && (target.y >= _mask->h - MAX_GRANULARITY))
+		y = target.y;
+
+	return (x >= target.x - MAX_GRANULARITY) && (x <= target.x + MAX_GRANULARITY) &&
+		(y >= target.y - MAX_GRANULARITY) && (y <= target.y + MAX_GRANULARITY);
+}
 
-	uint foundAnswer = (uint)-1;
-	while (iteration < 5000 && foundAnswer == (uint)-1) {
-		// TODO: Make these a single array?
-		Common::Array<uint> found;
-		Common::Array<uint> cheapest;
+// Search using A*, stepping through each walkable area at its granularity, until
+// all the targets have been reached (or there's nowhere left to go). The node
+// found for each target is stored in reached (or -1), and the route to it can
+// be followed back using the node parents.
+void PathFinder::searchRoutes(const Common::Point &from, const Common::Array<Common::Point> &targets, Common::Array<uint32> &reached) {
+	uint width = _mask->w, height = _mask->h;
+
+	reached.resize(targets.size());
+	for (uint i = 0; i < reached.size(); ++i)
+		reached[i] = (uint32)-1;
+	uint remaining = targets.size();
+
+	// prepare the scratch space; nodes from earlier searches are ignored,
+	// so it only needs clearing when the search id wraps around
+	Common::Array<WalkableAreaInfo::SearchNode> &nodes = _areaInfo->_searchNodes;
+	Common::Array<WalkableAreaInfo::OpenNode> &open = _areaInfo->_openNodes;
+	if (nodes.size() != width * height) {
+		nodes.resize(width * height);
+		_areaInfo->_searchId = 0;
+	}
+	if (++_areaInfo->_searchId == 0) {
+		for (uint i = 0; i < nodes.size(); ++i)
+			nodes[i]._searchId = 0;
+		_areaInfo->_searchId = 1;
+	}
+	uint16 searchId = _areaInfo->_searchId;
+	open.clear();
+
+	// the estimate is to the nearest target which hasn't been reached yet
+	uint nearestTarget = 0;
+	uint32 nearestCost = (uint32)-1;
+	for (uint i = 0; i < targets.size(); ++i) {
+		uint32 cost = estimateCost(from.x, from.y, targets[i].x, targets[i].y);
+		if (cost < nearestCost) {
+			nearestCost = cost;
+			nearestTarget = i;
+		}
+	}
 
-		Common::Array<uint> replace;
+	uint32 start = from.y * width + from.x;
+	nodes[start]._cost = 0;
+	nodes[start]._parent = (uint32)-1;
+	nodes[start]._searchId = searchId;
+	nodes[start]._closed = false;
+
+	WalkableAreaInfo::OpenNode startNode;
+	startNode._estimate = nearestCost;
+	startNode._cost = 0;
+	startNode._pos = start;
+	pushOpenNode(open, startNode);
+
+	static const int neighborX[8] = { -1, 1, 0, 0, -1, 1, -1, 1 };
+	static const int neighborY[8] = { 0, 0, -1, 1, -1, -1, 1, 1 };
+
+	while (remaining && !open.empty()) {
+		WalkableAreaInfo::OpenNode current = popOpenNode(open);
+		WalkableAreaInfo::SearchNode &node = nodes[current._pos];
+		// (stale entry, a cheaper way here was found after this was added)
+		if (node._closed || current._cost != node._cost)
+			continue;
+		node._closed = true;
 
-		int min = 29999;
-		uint changeIter = iteration;
+		int x = current._pos % width;
+		int y = current._pos / width;
 
-		// Update each visited cell, to take into account newly-visited neighbours.
-		for (uint i = 0; i < iteration; ++i) {
-			// Skip already-exhausted cells.
-			if (visited[i] == (uint)-1)
+		bool reachedNearest = false;
+		for (uint i = 0; i < targets.size(); ++i) {
+			if (reached[i] != (uint32)-1 || !isNear(x, y, targets[i]))
 				continue;
 
-			int x = visited[i] % parent.w;
-			int y = visited[i] / parent.w;
-			int granularity = _walkAreaGranularity[*(const byte *)_mask->getBasePtr(x, y)];
+			// We're close enough to this target, hoorah!
+			reached[i] = current._pos;
+			remaining--;
+			if (i == nearestTarget)
+				reachedNearest = true;
+		}
+		if (!remaining)
+			break;
+		if (reachedNearest) {
+			// head for whichever target is closest from here instead
+			nearestCost = (uint32)-1;
+			for (uint i = 0; i < targets.size(); ++i) {
+				if (reached[i] != (uint32)-1)
+					continue;
+				uint32 cost = estimateCost(x, y, targets[i].x, targets[i].y);
+				if (cost < nearestCost) {
+					nearestCost = cost;
+					nearestTarget = i;
+				}
+			}
+		}
+		const Common::Point &target = targets[nearestTarget];
 
-			bool updated = false;
+		int granularity = _areaInfo->_granularity[*(const byte *)_mask->getBasePtr(x, y)];
 
-			if (x >= granularity)
-				updated |= dijkstraCheckNeighbor(x, y, x - granularity, y, (_dest.x < x) ? directionBonus : 0,
-					min, found, cheapest);
+		for (uint i = 0; i < 8; ++i) {
+			int nX = x + neighborX[i] * granularity;
+			int nY = y + neighborY[i] * granularity;
+			if (nX < 0 || nY < 0 || nX >= (int)width || nY >= (int)height)
+				continue;
+			if (*(const byte *)_mask->getBasePtr(nX, nY) == 0)
+				continue;
 
-			if (y >= granularity)
-				updated |= dijkstraCheckNeighbor(x, y, x, y - granularity, (_dest.y < y) ? directionBonus : 0,
-					min, found, cheapest);
+			uint stepCost = STRAIGHT_COST;
+			if (neighborX[i] && neighborY[i]) {
+				// don't cut corners
+				if (*(const byte *)_mask->getBasePtr(nX, y) == 0 || *(const byte *)_mask->getBasePtr(x, nY) == 0)
+					continue;
+				stepCost = DIAGONAL_COST;
+			}
 
-			if (x < _mask->w - granularity)
-				updated |= dijkstraCheckNeighbor(x, y, x + granularity, y, (_dest.x > x) ? directionBonus : 0,
-					min, found, cheapest);
+			uint32 pos = nY * width + nX;
+			uint32 cost = current._cost + stepCost * granularity;
+			WalkableAreaInfo::SearchNode &neighbor = nodes[pos];
+			if (neighbor._searchId == searchId && (neighbor._closed || neighbor._cost <= cost))
+				continue;
 
-			if (y < _mask->h - granularity)
-				updated |= dijkstraCheckNeighbor(x, y, x, y + granularity, (_dest.y > y) ? directionBonus : 0,
-					min, found, cheapest);
+			neighbor._cost = cost;
+			neighbor._parent = current._pos;
+			neighbor._searchId = searchId;
+			neighbor._closed = false;
 
-			if (!updated) {
-				// If all the adjacent cells have been done, stop checking this one
-				visited[replace.size()] = (uint)-1;
-				assert(i < 5000);
-				replace.push_back(i);
-			}
+			WalkableAreaInfo::OpenNode openNode;
+			openNode._estimate = cost + estimateCost(nX, nY, target.x, target.y);
+			openNode._cost = cost;
+			openNode._pos = pos;
+			pushOpenNode(open, openNode);
 		}
+	}
 
-		if (found.empty()) {
-			// No further candidates, give up.
-			parent.free();
-			return false;
-		}
-
-		totalFound += found.size();
-
-		for (uint i = 0; i < found.size(); ++i) {
-			int newX = found[i] % _mask->w;
-			int newY = found[i] / _mask->w;
+	open.clear();
+}
 
-			assert(found[i] != cheapest[i]);
+// Fill in the path positions (from the destination back to the start), using
+// the route found to the given node. If the search went from the destination
+// to the start, rather than the other way round, the route is reversed.
+void PathFinder::addRoute(uint32 node, bool reversed) {
+	const Common::Array<WalkableAreaInfo::SearchNode> &nodes = _areaInfo->_searchNodes;
 
-			// Cost of this cell = cost of cheapest adjacent neighbor + 1.
-			uint cheapestX = cheapest[i] % _mask->w;
-			uint cheapestY = cheapest[i] / _mask->w;
-			*(int16 *)_beenHere.getBasePtr(newX, newY) = *(int16 *)_beenHere.getBasePtr(cheapestX, cheapestY) + 1;
+	_pathBackPositions.push_back(_dest);
 
-			// And that neighbor is our 'parent'.
-			parentVals[found[i]] = cheapest[i];
+	uint first = _pathBackPositions.size();
+	for (uint32 on = node; on != (uint32)-1; on = nodes[on]._parent) {
+		int newX = on % _mask->w;
+		int newY = on / _mask->w;
 
-			// The edges of the screen pose a problem, so if the current position
-			// and the destination are both within a certain distance of the edge,
-			// just snap to the destination.
-			if ((newX >= _mask->w - MAX_GRANULARITY) && (_dest.x >= _mask->w - MAX_GRANULARITY))
-				newX = _dest.x;
-			if ((newY >= _mask->h - MAX_GRANULARITY) && (_dest.y >= _mask->h - MAX_GRANULARITY))
-				newY = _dest.y;
+		// (too close to the destination to be useful)
+		if ((newX >= _dest.x - MAX_GRANULARITY) && (newX <= _dest.x + MAX_GRANULARITY) &&
+			(newY >= _dest.y - MAX_GRANULARITY) && (newY <= _dest.y + MAX_GRANULARITY))
+			continue;
 
-			if ((newX >= _dest.x - MAX_GRANULARITY) && (newX <= _dest.x + MAX_GRANULARITY) &&
-				(newY >= _dest.y - MAX_GRANULARITY) && (newY <= _dest.y + MAX_GRANULARITY)) {
-				// We're close enough to the destination, hoorah, done!
-				foundAnswer = found[i];
-				break;
-			}
+		_pathBackPositions.push_back(Common::Point(newX, newY));
+	}
 
-			if (totalFound >= 1000) {
-				// Ever so often, check if we can see the destination.
-				// TODO: This seems silly, and original says "Doesn't work cos it
-				// can see the destination from the point that's not nearest".
-				if (canSee(Common::Point(newX, newY), _dest, _mask)) {
-					directionBonus -= 50;
-					totalFound = 0;
-				}
-			}
+	if (reversed) {
+		for (uint i = first, j = _pathBackPositions.size() - 1; i < j; ++i, --j)
+			SWAP(_pathBackPositions[i], _pathBackPositions[j]);
+	}
+}
 
-			if (!replace.empty()) {
-				changeIter = replace.back();
-				replace.pop_back();
-			} else
-				changeIter = iteration;
+// the size of the cells which the path cache treats as being the same place
+const int PATH_CACHE_CELL_SIZE = 8;
+// how many routes to remember (per room)
+const uint PATH_CACHE_SIZE = 64;
 
-			visited[changeIter] = found[i];
-			if (changeIter == iteration)
-				iteration++;
+static WalkableAreaInfo::PathCacheKey makePathCacheKey(const WalkableAreaInfo *areaInfo, const Common::Point &from, const Common::Point &to) {
+	uint cellsWide = (areaInfo->_width + PATH_CACHE_CELL_SIZE - 1) / PATH_CACHE_CELL_SIZE;
 
-			changeIter = iteration;
+	WalkableAreaInfo::PathCacheKey key;
+	key._startCell = (from.y / PATH_CACHE_CELL_SIZE) * cellsWide + from.x / PATH_CACHE_CELL_SIZE;
+	key._goalCell = (to.y / PATH_CACHE_CELL_SIZE) * cellsWide + to.x / PATH_CACHE_CELL_SIZE;
+	key._generation = areaInfo->_generation;
+	return key;
+}
 
-			// Make sure we don't violate the outer loop condition.
-			if (iteration >= 5000)
-				break;
-		}
+// Try using a route found earlier for a nearby start and destination.
+bool PathFinder::findCachedRoute() {
+	const Common::Point &from = _moveList->_from;
 
-		if (totalFound >= 1000)
-			totalFound = 0;
-	}
+	WalkableAreaInfo::PathCacheKey key = makePathCacheKey(_areaInfo, from, _dest);
+	if (!_areaInfo->_pathCache.contains(key))
+		return false;
+	const Common::Array<Common::Point> &route = _areaInfo->_pathCache[key];
 
-	if (iteration >= 5000) {
-		// Too many iterations, give up.
-		parent.free();
+	// the ends of the route must work from our exact positions
+	// (they might be on the other side of a thin wall)
+	if (route.empty()) {
+		if (!canSee(from, _dest, _mask))
+			return false;
+	} else if (!canSee(from, route.back(), _mask) || !canSee(route[0], _dest, _mask))
 		return false;
-	}
 
 	_pathBackPositions.push_back(_dest);
+	for (uint i = 0; i < route.size(); ++i)
+		_pathBackPositions.push_back(route[i]);
 
-	for (uint on = parentVals[foundAnswer]; on != (uint)-1; on = parentVals[on]) {
-		assert(parentVals[on] != on);
+	return true;
+}
 
-		int newX = on % _mask->w;
-		int newY = on / _mask->w;
+// Remember the route we just constructed. Only the stages in between the start
+// and destination are kept (in reverse order, like the path positions), so
+// constructing a path from them again is cheap.
+void PathFinder::cacheRoute() {
+	if (_areaInfo->_pathCache.size() >= PATH_CACHE_SIZE)
+		_areaInfo->_pathCache.clear();
+
+	const Common::Array<MoveStage> &stages = _moveList->_stages;
+	Common::Array<Common::Point> &route = _areaInfo->_pathCache[makePathCacheKey(_areaInfo, _moveList->_from, _dest)];
+	route.clear();
+	for (int i = (int)stages.size() - 2; i >= 1; --i)
+		route.push_back(stages[i].pos);
+}
 
-		// Done?
-		if ((newX >= _dest.x - MAX_GRANULARITY) && (newX <= _dest.x + MAX_GRANULARITY) &&
-			(newY >= _dest.y - MAX_GRANULARITY) && (newY <= _dest.y + MAX_GRANULARITY))
-			break;
+// Try to find a route using A* (or the cache).
+bool PathFinder::findRouteAStar() {
+	Common::Point from = roundDownCoordinates(_moveList->_from);
 
-		_pathBackPositions.push_back(Common::Point(newX, newY));
+	// already at destination, once adjusted?
+	if (from == roundDownCoordinates(_dest))
+		return true;
+
+	if (findCachedRoute())
+		return true;
+
+	Common::Array<Common::Point> targets;
+	targets.push_back(_dest);
+	Common::Array<uint32> reached;
+	searchRoutes(from, targets, reached);
+
+	if (reached[0] == (uint32)-1) {
+		// The destination can't be reached from here.
+		return false;
 	}
 
-	parent.free();
+	addRoute(reached[0], false);
+	_routeSearched = true;
 	return true;
 }
 
@@ -876,7 +1022,7 @@ bool canSee(const Common::Point &from, const Common::Point &to, const Graphics::
 }
 
 bool findPath(AGSEngine *vm, const Common::Point &from, const Common::Point &to, const Graphics::Surface *mask,
-	MoveList *moveList, int speedX, int speedY, bool onlyIfDestAllowed, bool ignoreWalls) {
+	const WalkableAreaInfo *areaInfo, MoveList *moveList, int speedX, int speedY, bool onlyIfDestAllowed, bool ignoreWalls) {
 
 	// Reset the state of the move list.
 	moveList->_stages.clear();
@@ -890,14 +1036,22 @@ bool findPath(AGSEngine *vm, const Common::Point &from, const Common::Point &to,
 	// Construct a pathfinder.
 	PathFinder pathfinder;
 	pathfinder._mask = mask;
+	pathfinder._areaInfo = areaInfo;
 	pathfinder._moveList = moveList;
 	pathfinder._dest = to;
-	pathfinder._beenHere.create(mask->w, mask->h, Graphics::PixelFormat(2, 0, 0, 0, 0, 0, 0, 0, 0));
 	pathfinder._hasFinalStep = false;
+	pathfinder._routeSearched = false;
 
 	// Find a path.
 	bool foundPath = true;
+	WalkableAreaInfo tempAreaInfo;
 	if (!ignoreWalls && !canSee(from, to, mask)) {
+		if (!areaInfo) {
+			tempAreaInfo.calculate(*mask);
+			pathfinder._areaInfo = &tempAreaInfo;
+		}
+		assert(pathfinder._areaInfo->_width == mask->w && pathfinder._areaInfo->_height == mask->h);
+
 		if (!pathfinder.findPath(onlyIfDestAllowed)) {
 			// give up
 			foundPath = false;
@@ -907,13 +1061,112 @@ bool findPath(AGSEngine *vm, const Common::Point &from, const Common::Point &to,
 	// Construct the path.
 	if (foundPath)
 		foundPath = pathfinder.constructPath();
+	if (foundPath && pathfinder._routeSearched)
+		pathfinder.cacheRoute();
 
 	if (vm->getGameOption(OPT_NATIVECOORDINATES) && vm->_gameFile->_defaultResolution > 2)
 		moveList->convertToHighRes(vm->_graphics->_screenResolutionMultiplier);
 
 	// Done!
-	pathfinder._beenHere.free();
 	return foundPath;
 }
 
+// Would findPath need to search for a route to answer this?
+static bool needsSearch(const PathRequest &request, const Graphics::Surface *mask, const WalkableAreaInfo *areaInfo) {
+	const Common::Point &from = request._from, &to = request._to;
+
+	if (request._ignoreWalls || from == to)
+		return false;
+	if (from.x < 0 || from.y < 0 || from.x >= mask->w || from.y >= mask->h)
+		return false;
+	if (to.x < 0 || to.y < 0 || to.x >= mask->w || to.y >= mask->h)
+		return false;
+
+	// (unreachable destinations get moved, so they're left to findPath)
+	uint16 label = areaInfo->getLabel(from.x, from.y);
+	if (!label || areaInfo->getLabel(to.x, to.y) != label)
+		return false;
+
+	return !canSee(from, to, mask);
+}
+
+void findPaths(AGSEngine *vm, const Graphics::Surface *mask, const WalkableAreaInfo *areaInfo,
+	Common::Array<PathRequest> &requests) {
+
+	WalkableAreaInfo tempAreaInfo;
+	if (!areaInfo) {
+		tempAreaInfo.calculate(*mask);
+		areaInfo = &tempAreaInfo;
+	}
+	assert(areaInfo->_width == mask->w && areaInfo->_height == mask->h);
+
+	// Requests going to the same place (which need a search, and aren't already
+	// in the cache) are answered by a single search backwards from there. The
+	// routes found are put in the cache, where findPath finds them below.
+	Common::Array<bool> grouped;
+	grouped.resize(requests.size());
+	for (uint i = 0; i < requests.size(); ++i)
+		grouped[i] = !needsSearch(requests[i], mask, areaInfo);
+
+	for (uint i = 0; i < requests.size(); ++i) {
+		if (grouped[i])
+			continue;
+
+		WalkableAreaInfo::PathCacheKey goalKey = makePathCacheKey(areaInfo, requests[i]._to, requests[i]._to);
+
+		Common::Array<uint> group;
+		Common::Array<Common::Point> starts;
+		for (uint j = i; j < requests.size(); ++j) {
+			if (grouped[j] || !(makePathCacheKey(areaInfo, requests[j]._to, requests[j]._to) == goalKey))
+				continue;
+			grouped[j] = true;
+
+			if (areaInfo->_pathCache.contains(makePathCacheKey(areaInfo, requests[j]._from, requests[j]._to)))
+				continue;
+			group.push_back(j);
+			starts.push_back(requests[j]._from);
+		}
+
+		// (a single request is searched for as usual)
+		if (group.size() < 2)
+			continue;
+
+		PathFinder pathfinder;
+		pathfinder._mask = mask;
+		pathfinder._areaInfo = areaInfo;
+		pathfinder._dest = requests[i]._to;
+
+		Common::Array<uint32> reached;
+		pathfinder.searchRoutes(pathfinder.roundDownCoordinates(requests[i]._to), starts, reached);
+
+		debug(4, "findPaths: one search for %d routes to %d,%d", group.size(), requests[i]._to.x, requests[i]._to.y);
+
+		for (uint j = 0; j < group.size(); ++j) {
+			if (reached[j] == (uint32)-1)
+				continue;
+
+			MoveList moveList;
+			moveList._from = starts[j];
+			// (only the stages are kept, but constructPath works out their speeds)
+			moveList.setRouteMoveSpeed(requests[group[j]]._speedX, requests[group[j]]._speedY);
+
+			PathFinder route;
+			route._mask = mask;
+			route._areaInfo = areaInfo;
+			route._moveList = &moveList;
+			route._dest = requests[group[j]]._to;
+			route._hasFinalStep = false;
+			route.addRoute(reached[j], true);
+			if (route.constructPath())
+				route.cacheRoute();
+		}
+	}
+
+	for (uint i = 0; i < requests.size(); ++i) {
+		PathRequest &request = requests[i];
+		request._found = findPath(vm, request._from, request._to, mask, areaInfo, request._moveList,
+			request._speedX, request._speedY, request._onlyIfDestAllowed, request._ignoreWalls);
+	}
+}
+
 } // End of namespace AGS
@@ -29,8 +29,11 @@
 
 #include "common/array.h"
 #include "common/frac.h"
+#include "common/hashmap.h"
 #include "common/rect.h"
 
+#include "engines/ags/constants.h"
+
 namespace Graphics {
 struct Surface;
 }
@@ -64,9 +67,72 @@ struct MoveList {
 	void calculateMoveStage(uint stageId);
 };
 
+// connectivity of a walkable mask, which only needs recalculating when the mask changes
+struct WalkableAreaInfo {
+	WalkableAreaInfo() : _width(0), _height(0), _generation(0), _searchId(0) { }
+
+	// (the generation identifies this version of the mask, for the route cache)
+	void calculate(const Graphics::Surface &mask, uint32 generation = 0);
+	void clear();
+
+	// which connected part of the mask a pixel is in (0 if not walkable)
+	uint16 getLabel(uint x, uint y) const { return _labels[y * _width + x]; }
+
+	uint _width, _height;
+	// the generation of the mask this was calculated for
+	uint32 _generation;
+	Common::Array<uint16> _labels;
+	// the average 'width' of each walkable area, used as a step size
+	int _granularity[MAX_WALK_AREAS + 1];
+
+	// scratch space for the pathfinder, kept here so it doesn't need
+	// allocating (or clearing) for every search
+	struct SearchNode {
+		uint32 _cost, _parent;
+		uint16 _searchId;
+		bool _closed;
+	};
+	struct OpenNode {
+		uint32 _estimate, _cost, _pos;
+	};
+	mutable Common::Array<SearchNode> _searchNodes;
+	mutable Common::Array<OpenNode> _openNodes;
+	mutable uint16 _searchId;
+
+	// routes found recently, for coarse start and goal positions
+	struct PathCacheKey {
+		uint32 _startCell, _goalCell, _generation;
+
+		bool operator==(const PathCacheKey &other) const {
+			return _startCell == other._startCell && _goalCell == other._goalCell && _generation == other._generation;
+		}
+	};
+	struct PathCacheKeyHash {
+		uint operator()(const PathCacheKey &key) const {
+			return (key._startCell * 31 + key._goalCell) * 31 + key._generation;
+		}
+	};
+	mutable Common::HashMap<PathCacheKey, Common::Array<Common::Point>, PathCacheKeyHash> _pathCache;
+};
+
+// one query in a batch for findPaths
+struct PathRequest {
+	Common::Point _from, _to;
+	MoveList *_moveList;
+	int _speedX, _speedY;
+	bool _onlyIfDestAllowed, _ignoreWalls;
+
+	// set to the result findPath would have returned
+	bool _found;
+};
+
 bool canSee(const Common::Point &from, const Common::Point &to, const Graphics::Surface *mask, Common::Point *lastGoodPos = NULL);
+// areaInfo must match the mask (or be NULL, to calculate it here)
 bool findPath(class AGSEngine *vm, const Common::Point &from, const Common::Point &to, const Graphics::Surface *mask,
-	MoveList *moveList, int speedX, int speedY, bool onlyIfDestAllowed, bool ignoreWalls);
+	const WalkableAreaInfo *areaInfo, MoveList *moveList, int speedX, int speedY, bool onlyIfDestAllowed, bool ignoreWalls);
+// answers several queries at once; those going to the same place share a single search
+void findPaths(class AGSEngine *vm, const Graphics::Surface *mask, const WalkableAreaInfo *areaInfo,
+	Common::Array<PathRequest> &requests);
 
 } // End of namespace AGS
 
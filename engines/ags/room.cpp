@@ -26,6 +26,7 @@
 
 #include "engines/ags/ags.h"
 #include "engines/ags/constants.h"
+#include "engines/ags/gamefile.h"
 #include "engines/ags/gamestate.h"
 #include "engines/ags/graphics.h"
 #include "engines/ags/pathfinder.h"
@@ -36,47 +37,70 @@
 
 namespace AGS {
 
-static void decompressLZSS(Common::SeekableReadStream *stream, byte *outBuf, uint32 destSize) {
+// The history buffer is just the output so far; anything referring back
+// before the start of the output reads as zero. Returns the number of
+// compressed bytes used, and sets destSize to the number of bytes produced.
+static uint32 decompressLZSS(const byte *src, uint32 srcSize, byte *outBuf, uint32 &destSize) {
 	const uint32 N = 4096; // history buffer size (2^12)
-	const uint32 F = 16;
 	const uint32 THRESHOLD = 3; // base threshold for encoded strings
 
-	byte buffer[N];
+	const byte *srcStart = src;
+	const byte *srcEnd = src + srcSize;
+	byte *out = outBuf;
+	byte *outEnd = outBuf + destSize;
 
-	uint32 bufPos = N - F;
-	uint32 outPos = 0;
-
-	while (outPos < destSize && !stream->eos()) {
-		byte flagBits = stream->readByte();
+	while (out < outEnd && src < srcEnd) {
+		byte flagBits = *src++;
 
 		// 8 bits
-		for (uint32 i = 1; (i <= 8) && (outPos < destSize); i++) {
+		for (uint32 i = 1; (i <= 8) && (out < outEnd); i++) {
 			if ((flagBits & 1) == 1) {
 				// string from history buffer
-				uint16 data = stream->readUint16LE();
+				if (srcEnd - src < 2) {
+					destSize = out - outBuf;
+					return srcEnd - srcStart;
+				}
+				uint16 data = READ_LE_UINT16(src);
+				src += 2;
 
-				uint32 length = ((data >> 12) & 0xF) + THRESHOLD;
-				uint32 inPos = (bufPos - data - 1) & (N - 1);
+				uint32 length = MIN<uint32>(((data >> 12) & 0xF) + THRESHOLD, outEnd - out);
+				uint32 dist = (data & (N - 1)) + 1;
+
+				// before the start of the output
+				while (length && dist > (uint32)(out - outBuf)) {
+					*out++ = 0;
+					length--;
+				}
 
-				while ((outPos < destSize) && length--) {
-					byte val = buffer[inPos];
-					outBuf[outPos++] = val;
-					buffer[bufPos] = val;
-					inPos = (inPos + 1) & (N - 1);
-					bufPos = (bufPos + 1) & (N - 1);
+				const byte *in = out - dist;
+				if (dist >= length) {
+					memcpy(out, in, length);
+					out += length;
+				} else if (dist == 1) {
+					// a run of the same byte
+					memset(out, *in, length);
+					out += length;
+				} else {
+					// overlapping, so this repeats the last dist bytes
+					while (length--)
+						*out++ = *in++;
 				}
 			} else {
 				// byte (to add to history buffer)
-				byte val = stream->readByte();
-				outBuf[outPos++] = val;
-				buffer[bufPos] = val;
-				bufPos = (bufPos + 1) & (N - 1);
+				if (src == srcEnd) {
+					destSize = out - outBuf;
+					return srcEnd - srcStart;
+				}
+				*out++ = *src++;
 			}
 
 			// next bit
 			flagBits = flagBits >> 1;
 		}
 	}
+
+	destSize = out - outBuf;
+	return src - srcStart;
 }
 
 static Graphics::Surface readLZSSImage(Common::SeekableReadStream *stream, Graphics::PixelFormat format, byte *destPalette, uint32 imageBpp) {
@@ -92,12 +116,17 @@ static Graphics::Surface readLZSSImage(Common::SeekableReadStream *stream, Graph
 	if (uncompressedSize < 8)
 		error("readLZSSImage: %d uncompressed bytes is insufficient (%d compressed)", uncompressedSize, compressedSize);
 
-	byte *buffer = new byte[uncompressedSize];
 	uint32 oldPos = stream->pos();
-	decompressLZSS(stream, buffer, uncompressedSize);
-	if (stream->eos() || (uint32)stream->pos() != oldPos + compressedSize)
-		error("readLZSSImage: failed to read %d compressed bytes of image (started at %d, got to %d, should be %d bytes)",
-			compressedSize, oldPos, stream->pos(), uncompressedSize);
+	byte *compressed = new byte[compressedSize];
+	uint32 readSize = stream->read(compressed, compressedSize);
+
+	byte *buffer = new byte[uncompressedSize];
+	uint32 producedSize = uncompressedSize;
+	uint32 usedSize = decompressLZSS(compressed, readSize, buffer, producedSize);
+	delete[] compressed;
+	if (readSize != compressedSize || usedSize != compressedSize || producedSize != uncompressedSize)
+		error("readLZSSImage: failed to read %d compressed bytes of image (started at %d, got to %d, produced %d of %d bytes)",
+			compressedSize, oldPos, oldPos + usedSize, producedSize, uncompressedSize);
 
 	uint32 widthBytes = READ_LE_UINT32(buffer);
 	uint32 height = READ_LE_UINT32(buffer + 4);
@@ -149,8 +178,19 @@ static Graphics::Surface readRLEImage(Common::SeekableReadStream *stream) {
 	uint16 height = stream->readUint16LE();
 	surf.create(width, height, Graphics::PixelFormat::createFormatCLUT8());
 
+	// we don't know the compressed size, so read as much as it could
+	// possibly be (runs are at most 128 bytes), and then seek back
+	uint32 start = stream->pos();
+	uint32 maxSize = MIN<uint32>(height * (width + width / 128 + 1), stream->size() - start);
+	byte *buffer = new byte[maxSize];
+	maxSize = stream->read(buffer, maxSize);
+
+	uint32 used = 0;
 	for (uint i = 0; i < height; ++i)
-		unpackSpriteBits(stream, (byte *)surf.getBasePtr(0, i), width);
+		used += unpackSpriteBits(buffer + used, maxSize - used, (byte *)surf.getBasePtr(0, i), width);
+
+	delete[] buffer;
+	stream->seek(start + used);
 
 	stream->skip(256 * 3); // skip palette
 
@@ -349,7 +389,7 @@ void RoomObject::move(int x, int y, int speed, bool ignoreWalkable) {
 	y = _vm->convertToLowRes(y);
 
 	Graphics::Surface *walkableMask = _vm->getWalkableMaskFor((uint)-1);
-	if (findPath(_vm, Common::Point(objX, objY), Common::Point(x, y), walkableMask, &_moveList, speed, speed, true, ignoreWalkable)) {
+	if (findPath(_vm, Common::Point(objX, objY), Common::Point(x, y), walkableMask, _vm->getCurrentRoom()->getWalkableAreaInfo(), &_moveList, speed, speed, true, ignoreWalkable)) {
 		_moving = true;
 		_moveList._direct = ignoreWalkable;
 	}
@@ -364,24 +404,43 @@ int RoomObject::getBaseline() const {
 }
 
 Common::Point RoomObject::getDrawPos() {
-	return Common::Point(_vm->multiplyUpCoordinate(_pos.x),
-		_vm->multiplyUpCoordinate(_pos.y) - _vm->getSprites()->getSpriteHeight(_spriteId));
+	return Common::Point(_vm->multiplyUpCoordinate(_pos.x), _vm->multiplyUpCoordinate(_pos.y) - getDrawHeight());
 }
 
 int RoomObject::getDrawOrder() const {
 	return getBaseline() + ((_flags & OBJF_NOWALKBEHINDS) ? _vm->getCurrentRoom()->_height : 0);
 }
 
+uint RoomObject::getScaling() {
+	if (!(_flags & OBJF_USEROOMSCALING))
+		return 100;
+
+	uint zoom = _vm->getAreaScalingFor(_vm->getWalkableAreaAt(_pos), _pos);
+	return (zoom == (uint)-1) ? 100 : zoom;
+}
+
 const Graphics::Surface *RoomObject::getDrawSurface() {
-	return _vm->getSprites()->getSprite(_spriteId)->_surface; // FIXME
+	SpriteTransform transform;
+	transform._scale = getScaling();
+	transform.setLighting(this);
+
+	uint32 frameTick = _vm->getSprites()->getFrameTick();
+	if (_drawSurface && _drawSurfaceTick == frameTick && _drawSpriteId == _spriteId && _drawTransform == transform)
+		return _drawSurface;
+
+	_drawSurface = _vm->getSprites()->getTransformedSprite(_spriteId, transform);
+	_drawSurfaceTick = frameTick;
+	_drawSpriteId = _spriteId;
+	_drawTransform = transform;
+	return _drawSurface;
 }
 
 uint RoomObject::getDrawWidth() {
-	return getDrawSurface()->w; // FIXME
+	return getDrawSurface()->w;
 }
 
 uint RoomObject::getDrawHeight() {
-	return getDrawSurface()->h; // FIXME
+	return getDrawSurface()->h;
 }
 
 uint RoomObject::getDrawTransparency() {
@@ -393,11 +452,33 @@ bool RoomObject::isDrawMirrored() {
 }
 
 int RoomObject::getDrawLightLevel() {
-	return 0; // FIXME
+	// an explicit tint replaces any lighting
+	if ((_flags & OBJF_HASTINT) || !(_flags & OBJF_USEREGIONTINTS))
+		return 0;
+
+	int lightLevel, tintAmount;
+	byte red, green, blue;
+	_vm->getCurrentRoom()->getLightingAt(_pos.x, _pos.y, lightLevel, tintAmount, red, green, blue);
+	return lightLevel;
 }
 
 void RoomObject::getDrawTint(int &lightLevel, int &luminance, byte &red, byte &green, byte &blue) {
-	// FIXME
+	if (_flags & OBJF_HASTINT) {
+		lightLevel = _tintLevel;
+		luminance = _tintLight;
+		red = _tintRed;
+		green = _tintGreen;
+		blue = _tintBlue;
+		return;
+	}
+
+	lightLevel = 0;
+	luminance = 255;
+	if (!(_flags & OBJF_USEREGIONTINTS))
+		return;
+
+	int regionLight;
+	_vm->getCurrentRoom()->getLightingAt(_pos.x, _pos.y, regionLight, lightLevel, red, green, blue);
 }
 
 #define ROOM_FILE_VERSION kAGSRoomVer303x // 29
@@ -416,7 +497,7 @@ void RoomObject::getDrawTint(int &lightLevel, int &luminance, byte &red, byte &g
 #define BLOCKTYPE_EOF         0xff
 
 Room::Room(AGSEngine *vm, Common::SeekableReadStream *dta) : _vm(vm), _compiledScript(NULL),
-	_savedScriptState(NULL), _interaction(NULL) {
+	_savedScriptState(NULL), _interaction(NULL), _walkableMaskGeneration(0) {
 
 	_backgroundSceneAnimSpeed = 5;
 	// FIXME: copy main background scene palette
@@ -454,6 +535,7 @@ void Room::unload() {
 	_backgroundScenes.clear();
 	_originalWalkableMask.free();
 	_walkableMask.free();
+	_walkableAreaInfo.clear();
 	_walkBehindMask.free();
 	_hotspotMask.free();
 	_regionsMask.free();
@@ -492,6 +574,7 @@ void Room::initWalkBehinds() {
 		_walkBehinds[i]._right = 0;
 		_walkBehinds[i]._bottom = 0;
 
+		_walkBehinds[i]._spans.clear();
 		_walkBehinds[i]._surface.free();
 	}
 
@@ -511,6 +594,26 @@ void Room::initWalkBehinds() {
 		}
 	}
 
+	// Then, split them into spans, so updating them is just copying those.
+	for (uint y = 0; y < _walkBehindMask.h; ++y) {
+		const byte *ptr = (const byte *)_walkBehindMask.getBasePtr(0, y);
+		uint x = 0;
+		while (x < _walkBehindMask.w) {
+			byte maskId = ptr[x];
+			uint start = x;
+			while (x < _walkBehindMask.w && ptr[x] == maskId)
+				x++;
+			if (maskId == 0 || maskId >= _walkBehinds.size())
+				continue;
+
+			WalkBehindSpan span;
+			span._x = start;
+			span._y = y;
+			span._width = x - start;
+			_walkBehinds[maskId]._spans.push_back(span);
+		}
+	}
+
 	// Finally, update the surfaces.
 	updateWalkBehinds();
 }
@@ -529,57 +632,81 @@ void Room::updateWalkBehinds() {
 
 		uint width = wb._right - wb._left + 1;
 		uint height = wb._bottom - wb._top + 1;
-		if (!wb._surface.getPixels())
+		if (!wb._surface.getPixels()) {
+			// (anything outside the spans stays transparent)
 			wb._surface.create(width, height, background.format);
-		else
+			// FIXME: pass format to getTransparentColor
+			wb._surface.fillRect(Common::Rect(0, 0, width, height), _vm->_graphics->getTransparentColor());
+		} else
 			assert(wb._surface.w == width && wb._surface.h == height);
 
-		// FIXME: pass format to getTransparentColor
-		wb._surface.fillRect(Common::Rect(0, 0, width, height), _vm->_graphics->getTransparentColor());
+		uint bytesPerPixel = background.format.bytesPerPixel;
+		for (uint j = 0; j < wb._spans.size(); ++j) {
+			const WalkBehindSpan &span = wb._spans[j];
+			memcpy(wb._surface.getBasePtr(span._x - wb._left, span._y - wb._top),
+				background.getBasePtr(span._x, span._y), span._width * bytesPerPixel);
+		}
+	}
+}
+
+void Room::redoWalkableAreas() {
+	assert(_originalWalkableMask.format.bytesPerPixel == 1);
+
+	if (!_walkableMask.getPixels()) {
+		// start from the original copy, and remember where each area is
+		_walkableMask.copyFrom(_originalWalkableMask);
+
+		for (uint i = 0; i <= MAX_WALK_AREAS; ++i) {
+			_walkableAreaBounds[i] = Common::Rect();
+			_walkableAreaEnabled[i] = true;
+		}
 
-		for (uint y = wb._top; y <= wb._bottom; y++) {
-			for (uint x = wb._left; x <= wb._right; x++) {
-				byte *ptr = (byte *)_walkBehindMask.getBasePtr(x, y);
-				if (*ptr != i)
+		for (uint y = 0; y < _walkableMask.h; y++) {
+			const byte *ptr = (const byte *)_walkableMask.getBasePtr(0, y);
+			for (uint x = 0; x < _walkableMask.w; x++) {
+				byte id = ptr[x];
+				if (!id || id > MAX_WALK_AREAS)
 					continue;
-				const void *srcPtr = background.getBasePtr(x, y);
-				void *destPtr = wb._surface.getBasePtr(x - wb._left, y - wb._top);
-				switch (background.format.bytesPerPixel) {
-				case 1:
-					*(byte *)destPtr = *(const byte *)srcPtr;
-					break;
-				case 2:
-					WRITE_UINT16(destPtr, READ_UINT16(srcPtr));
-					break;
-				case 4:
-					WRITE_UINT32(destPtr, READ_UINT32(srcPtr));
-					break;
-				}
-				//srcPtr = (byte *)srcPtr + background.format.bytesPerPixel;
-				//destPtr = (byte *)destPtr + background.format.bytesPerPixel;
+
+				Common::Rect &bounds = _walkableAreaBounds[id];
+				if (bounds.isEmpty())
+					bounds = Common::Rect(x, y, x + 1, y + 1);
+				else
+					bounds.extend(Common::Rect(x, y, x + 1, y + 1));
 			}
 		}
+
+		_walkableMaskGeneration++;
 	}
-}
 
-void Room::redoWalkableAreas() {
-	// restore the walkable areas mask from the original copy
-	_walkableMask.free();
-	_walkableMask.copyFrom(_originalWalkableMask);
-	assert(_walkableMask.format.bytesPerPixel == 1);
-
-	// clear any walkable areas which are disabled
-	for (uint y = 0; y < _walkableMask.h; y++) {
-		byte *ptr = (byte *)_walkableMask.getBasePtr(0, y);
-		for (uint x = 0; x < _walkableMask.w; x++) {
-			byte id = *ptr;
-			if (!_vm->_state->_walkableAreasOn[id])
-				*ptr = 0;
-			ptr++;
+	// only the areas which were enabled/disabled since last time need updating
+	for (uint id = 1; id <= MAX_WALK_AREAS; ++id) {
+		bool enabled = _vm->_state->_walkableAreasOn[id];
+		if (enabled == _walkableAreaEnabled[id])
+			continue;
+		_walkableAreaEnabled[id] = enabled;
+
+		const Common::Rect &bounds = _walkableAreaBounds[id];
+		for (int y = bounds.top; y < bounds.bottom; y++) {
+			const byte *src = (const byte *)_originalWalkableMask.getBasePtr(0, y);
+			byte *dest = (byte *)_walkableMask.getBasePtr(0, y);
+			for (int x = bounds.left; x < bounds.right; x++) {
+				if (src[x] == id)
+					dest[x] = enabled ? id : 0;
+			}
 		}
+
+		_walkableMaskGeneration++;
 	}
 }
 
+const WalkableAreaInfo *Room::getWalkableAreaInfo() {
+	if (_walkableAreaInfo._generation != _walkableMaskGeneration)
+		_walkableAreaInfo.calculate(_walkableMask, _walkableMaskGeneration);
+
+	return &_walkableAreaInfo;
+}
+
 uint Room::getHotspotAt(int x, int y) {
 	x = _vm->convertToLowRes(x);
 	y = _vm->convertToLowRes(y);
@@ -669,6 +796,34 @@ uint Room::getRegionAt(int x, int y) {
 	return regionId;
 }
 
+// 'get_local_tint' in original
+void Room::getLightingAt(int x, int y, int &lightLevel, int &tintAmount, byte &red, byte &green, byte &blue) {
+	lightLevel = 0;
+	tintAmount = 0;
+
+	uint regionId = getRegionAt(x, y);
+	// when walking, we might just be off a region
+	if (!regionId)
+		regionId = getRegionAt(x, y - 3);
+	if (regionId >= _regions.size())
+		return;
+	const RoomRegion &region = _regions[regionId];
+	if (!region._enabled)
+		return;
+
+	// (tints need hi-color, and a black tint means there isn't one)
+	if ((region._tintLevel & TINT_IS_ENABLED) && (region._tintLevel & 0xffffff) && _vm->_gameFile->_colorDepth > 1) {
+		red = region._tintLevel & 0xff;
+		green = (region._tintLevel >> 8) & 0xff;
+		blue = (region._tintLevel >> 16) & 0xff;
+		// the light level is the tint saturation here
+		tintAmount = CLIP<int>((int16)region._lightLevel, 0, 100);
+		return;
+	}
+
+	lightLevel = CLIP<int>((int16)region._lightLevel, -100, 100);
+}
+
 void Room::readData(Common::SeekableReadStream *dta) {
 	uint16 version = dta->readUint16LE();
 
@@ -890,6 +1045,7 @@ Room::~Room() {
 		_walkBehinds[i]._surface.free();
 	_originalWalkableMask.free();
 	_walkableMask.free();
+	_walkableAreaInfo.clear();
 	_walkBehindMask.free();
 	_hotspotMask.free();
 	_regionsMask.free();
@@ -34,6 +34,7 @@
 #include "engines/ags/drawable.h"
 #include "engines/ags/gamefile.h"
 #include "engines/ags/pathfinder.h"
+#include "engines/ags/sprites.h"
 
 namespace Common {
 	class SeekableReadStream;
@@ -58,10 +59,18 @@ struct FullAnimation {
 	Common::Array<AnimationStruct> _stages;
 };
 
+// a horizontal run of walkbehind pixels
+struct WalkBehindSpan {
+	uint16 _x, _y, _width;
+};
+
 struct WalkBehind : public Drawable {
 	uint _left, _top, _right, _bottom;
 	int16 _baseline; // was objyval: baseline of walkbehind area
 
+	// which pixels (in room coordinates) are part of this walkbehind
+	Common::Array<WalkBehindSpan> _spans;
+
 	Graphics::Surface _surface;
 
 	virtual Common::Point getDrawPos() { return Common::Point(_left, _top); }
@@ -76,6 +85,9 @@ struct WalkBehind : public Drawable {
 	virtual void getDrawTint(int &lightLevel, int &luminance, byte &red, byte &green, byte &blue) { }
 };
 
+// set in RoomRegion::_tintLevel if the region tints rather than lights
+#define TINT_IS_ENABLED 0x80000000
+
 struct RoomRegion : public ScriptObject {
 	RoomRegion() : _interaction(NULL), _lightLevel(0), _tintLevel(0), _enabled(true) { }
 	bool isOfType(ScriptObjectType objectType) { return (objectType == sotRegion); }
@@ -102,7 +114,8 @@ struct RoomRegion : public ScriptObject {
 struct RoomObject : public ScriptObject, public Drawable {
 	RoomObject(AGSEngine *vm, uint id) : _vm(vm), _interaction(NULL), _flags(0), _id(id),
 		_view((uint16)-1), _loop(0), _frame(0), _wait(0), _cycling(0), _transparency(0), _moving(-1),
-		_blockingWidth(0), _blockingHeight(0), _baseline(-1) { }
+		_blockingWidth(0), _blockingHeight(0), _baseline(-1), _drawSurface(NULL), _drawSurfaceTick(0),
+		_drawSpriteId(0) { }
 	bool isOfType(ScriptObjectType objectType) { return (objectType == sotRoomObject); }
 	const char *getObjectTypeName() { return "RoomObject"; }
 
@@ -135,6 +148,7 @@ struct RoomObject : public ScriptObject, public Drawable {
 	void stopMoving();
 
 	int getBaseline() const;
+	uint getScaling();
 
 	uint _id;
 
@@ -180,6 +194,12 @@ protected:
 	AGSEngine *_vm;
 
 	MoveList _moveList;
+
+	// the last transformed sprite, reused within a frame while the transform matches
+	const Graphics::Surface *_drawSurface;
+	uint32 _drawSurfaceTick;
+	uint16 _drawSpriteId;
+	SpriteTransform _drawTransform;
 };
 
 #define MSG_DISPLAYNEXT 1 // supercedes using alt-200 at end of message
@@ -250,12 +270,16 @@ public:
 	void initWalkBehinds();
 	void updateWalkBehinds();
 
+	// updates the walkable mask after areas were enabled/disabled
 	void redoWalkableAreas();
+	// (recalculated here if the mask changed since it was last needed)
+	const WalkableAreaInfo *getWalkableAreaInfo();
 
 	uint getHotspotAt(int x, int y);
 	uint getObjectAt(int x, int y);
 	uint getObjectAt(int x, int y, int &id);
 	uint getRegionAt(int x, int y);
+	void getLightingAt(int x, int y, int &lightLevel, int &tintAmount, byte &red, byte &green, byte &blue);
 
 protected:
 	AGSEngine *_vm;
@@ -269,6 +293,10 @@ public:
 
 	Graphics::Surface _originalWalkableMask; // walkareabackup
 	Graphics::Surface _walkableMask; // walls - as updated (scripts, characters)
+	WalkableAreaInfo _walkableAreaInfo; // connectivity of _walkableMask
+	uint32 _walkableMaskGeneration; // incremented whenever _walkableMask changes
+	Common::Rect _walkableAreaBounds[MAX_WALK_AREAS + 1];
+	bool _walkableAreaEnabled[MAX_WALK_AREAS + 1]; // as currently in _walkableMask
 	Graphics::Surface _walkBehindMask; // object
 	Graphics::Surface _hotspotMask; // lookat
 	Graphics::Surface _regionsMask; // regions
@@ -27,6 +27,7 @@
 #include "engines/ags/ags.h"
 #include "engines/ags/script.h"
 #include "engines/ags/dynamicarray.h"
+#include "engines/ags/scriptprofiler.h"
 #include "engines/ags/scripting/scripting.h"
 #include "engines/ags/util.h"
 #include "engines/ags/vm.h"
@@ -45,6 +46,11 @@ namespace AGS {
 #define CC_STACK_SIZE     4000
 #define MAX_CALL_STACK    100
 
+ccScript::~ccScript() {
+	for (Common::HashMap<uint32, ScriptConstString *>::iterator i = _stringObjects.begin(); i != _stringObjects.end(); ++i)
+		i->_value->DecRef();
+}
+
 void ccScript::readFrom(Common::SeekableReadStream *dta) {
 	_instances = 0;
 
@@ -73,6 +79,10 @@ void ccScript::readFrom(Common::SeekableReadStream *dta) {
 	if (stringsSize)
 		dta->read(&_strings[0], stringsSize);
 
+	_globalFixups.resize((globalDataSize + 7) / 8);
+	for (uint i = 0; i < _globalFixups.size(); ++i)
+		_globalFixups[i] = 0;
+
 	uint32 fixupsCount = dta->readUint32LE();
 	Common::Array<byte> fixupTypes;
 	fixupTypes.resize(fixupsCount);
@@ -91,7 +101,11 @@ void ccScript::readFrom(Common::SeekableReadStream *dta) {
 		if (fixupTypes[i] == FIXUP_DATADATA) {
 			// patch to global data
 			// (usually strings, there aren't many of these)
-			_globalFixups.push_back(fixupIndex);
+			if (fixupIndex >= globalDataSize) {
+				warning("ignoring global data fixup for %d, beyond data size %d", fixupIndex, globalDataSize);
+				continue;
+			}
+			_globalFixups[fixupIndex >> 3] |= (1 << (fixupIndex & 7));
 		} else if (fixupTypes[i] && fixupTypes[i] <= 6) {
 			// patch to code
 			if (fixupIndex >= _code.size())
@@ -112,7 +126,6 @@ void ccScript::readFrom(Common::SeekableReadStream *dta) {
 			error("invalid fixup type %d", fixupTypes[i]);
 		}
 	}
-	Common::sort(_globalFixups.begin(), _globalFixups.end());
 
 	debug(3, "script has %d fixups for %d code entries", fixupsCount, codeSize);
 
@@ -155,8 +168,27 @@ void ccScript::readFrom(Common::SeekableReadStream *dta) {
 		default:
 			error("script export '%s' had unknown type %d", _exports[i]._name.c_str(), exportType);
 		}
+
+		// index by the full name, and by the name without the parameter count
+		// (the first export wins, in both cases)
+		const char *mangled = strrchr(_exports[i]._name.c_str(), '$');
+		_exports[i]._paramCount = mangled ? atoi(mangled + 1) : -1;
+		if (!_exportIndex.contains(_exports[i]._name))
+			_exportIndex[_exports[i]._name] = i;
+		if (mangled) {
+			Common::String name(_exports[i]._name.c_str(), mangled);
+			if (!_exportIndex.contains(name))
+				_exportIndex[name] = i;
+		}
 	}
 
+	static const char *const eventNames[kScriptEventCount] = {
+		"repeatedly_execute",
+		"repeatedly_execute_always"
+	};
+	for (uint i = 0; i < kScriptEventCount; ++i)
+		_eventExports[i] = findExport(eventNames[i]);
+
 	if (version >= 83) {
 		uint32 sectionsCount = dta->readUint32LE();
 		_sections.resize(sectionsCount);
@@ -170,27 +202,39 @@ void ccScript::readFrom(Common::SeekableReadStream *dta) {
 	uint32 endsig = dta->readUint32LE();
 	if (endsig != 0xbeefcafe)
 		error("incorrect end signature %x for script", endsig);
+
+	decodeInstructions();
+	verifyInstructions();
 }
 
 ccInstance::ccInstance(AGSEngine *vm, ccScript *script, bool autoImport, ccInstance *fork, ScriptState *oldState)
 	: _vm(vm), _script(script) {
 
 	_flags = 0;
+	_instructionCount = 0;
+	_paramDepth = 0;
 
 	if (fork) {
 		assert(!oldState);
 		// share memory space with an existing instance (ie. this is a thread/fork)
 		_globalData = fork->_globalData;
 		_globalObjects = fork->_globalObjects;
+		_globalObjectMap = fork->_globalObjectMap;
 		_flags |= INSTF_SHAREDATA;
 	} else {
 		// create our own memory space
 		_globalData = new Common::Array<byte>(script->_globalData);
 		_globalObjects = new Common::HashMap<uint32, RuntimeValue>();
+		_globalObjectMap = new Common::Array<byte>();
+		_globalObjectMap->resize((_globalData->size() + 7) / 8);
+		for (uint i = 0; i < _globalObjectMap->size(); ++i)
+			(*_globalObjectMap)[i] = 0;
 
 		if (oldState) {
 			*_globalData = oldState->_globalData;
-			*_globalObjects = oldState->_globalObjects;
+			for (Common::HashMap<uint32, RuntimeValue>::iterator i = oldState->_globalObjects.begin();
+				i != oldState->_globalObjects.end(); ++i)
+				setGlobalObject(i->_key, i->_value);
 			delete oldState;
 		}
 	}
@@ -230,13 +274,17 @@ ccInstance::ccInstance(AGSEngine *vm, ccScript *script, bool autoImport, ccInsta
 
 	_registers.resize(CC_NUM_REGISTERS);
 	_stack.resize(CC_STACK_SIZE);
-	for (uint i = 0; i < _stack.size(); ++i)
-		_stack[i].invalidate();
+	memset(&_stack[0], 0, _stack.size());
+	_stackTypes.resize(CC_STACK_SIZE);
+	memset(&_stackTypes[0], rvtInvalid, _stackTypes.size());
 }
 
 ccInstance::~ccInstance() {
 	_script->_instances--;
 	if (_script->_instances == 0) {
+		if (_vm->getScriptProfiler())
+			_vm->getScriptProfiler()->forgetScript(_script);
+
 		// FIXME: must make sure that nothing is referencing these!
 
 		GlobalScriptState *state = _vm->getScriptState();
@@ -265,55 +313,49 @@ ccInstance::~ccInstance() {
 	if (!(_flags & INSTF_SHAREDATA)) {
 		delete _globalData;
 		delete _globalObjects;
+		delete _globalObjectMap;
 	}
+
+	for (uint i = 0; i < _paramBuffers.size(); ++i)
+		delete _paramBuffers[i];
 }
 
-bool ccInstance::exportsSymbol(const Common::String &name) {
-	Common::String mangledName = name + '$';
+int ccScript::findExport(const Common::String &name) const {
+	Common::HashMap<Common::String, uint32, Common::CaseSensitiveString_Hash, Common::CaseSensitiveString_EqualTo>::const_iterator i;
+	i = _exportIndex.find(name);
+	if (i == _exportIndex.end())
+		return -1;
+	return i->_value;
+}
 
-	for (uint i = 0; i < _script->_exports.size(); ++i) {
-		const ScriptExport &symbol = _script->_exports[i];
+bool ccInstance::exportsSymbol(const Common::String &name) {
+	return (findExport(name) != -1);
+}
 
-		if (symbol._name.hasPrefix(mangledName))
-			return true;
-		else if (symbol._name == name)
-			return true;
-	}
+void ccInstance::call(const Common::String &name, const Common::Array<RuntimeValue> &params) {
+	int exportId = findExport(name);
+	if (exportId == -1)
+		error("attempt to call() function '%s' which doesn't exist", name.c_str());
 
-	return false;
+	call((uint)exportId, params);
 }
 
-void ccInstance::call(const Common::String &name, const Common::Array<RuntimeValue> &params) {
+void ccInstance::call(uint exportId, const Common::Array<RuntimeValue> &params) {
+	const ScriptExport &symbol = _script->_exports[exportId];
+	const Common::String &name = symbol._name;
+
 	if (params.size() >= 20)
 		error("too many arguments %d to function '%s'", params.size(), name.c_str());
 
 	if (_pc != 0)
 		error("attempt to call() on a running instance, when calling function '%s'", name.c_str());
 
-	Common::String mangledName = name + '$';
-	uint32 codeLoc = 0xffffffff;
-	for (uint i = 0; i < _script->_exports.size(); ++i) {
-		const ScriptExport &symbol = _script->_exports[i];
-		if (symbol._name.hasPrefix(mangledName)) {
-			// mangled name
-			uint32 paramCount = atoi(symbol._name.c_str() + mangledName.size());
-			if (paramCount != params.size())
-				error("tried calling function '%s' with %d parameters, but it takes %d",
-					symbol._name.c_str(), params.size(), paramCount);
-		} else if (symbol._name != name) {
-			// not an unmangled name from old compiler, no match
-			continue;
-		}
-
-		if (symbol._type != sitScriptFunction)
-			error("attempt to call() '%s' which isn't a function", symbol._name.c_str());
-		codeLoc = symbol._address;
-		break;
-	}
-
-	if (codeLoc == 0xffffffff) {
-		error("attempt to call() function '%s' which doesn't exist", name.c_str());
-	}
+	if (symbol._paramCount != -1 && (uint)symbol._paramCount != params.size())
+		error("tried calling function '%s' with %d parameters, but it takes %d",
+			name.c_str(), params.size(), symbol._paramCount);
+	if (symbol._type != sitScriptFunction)
+		error("attempt to call() '%s' which isn't a function", name.c_str());
+	uint32 codeLoc = symbol._address;
 
 	debugN(2, "running function: '%s'@%d", name.c_str(), codeLoc);
 	//for (uint i = 0; i < params.size(); i++)
@@ -344,7 +386,13 @@ void ccInstance::call(const Common::String &name, const Common::Array<RuntimeVal
 	pushValue(0);
 
 	_runningInst = this;
+	uint32 instructionsWere = _instructionCount;
+	uint32 startTime = g_system->getMillis();
+	if (_vm->getScriptProfiler())
+		_vm->getScriptProfiler()->enterFunction(_script, codeLoc, _instructionCount);
 	runCodeFrom(codeLoc);
+	debug(3, "function '%s' ran %d instructions in %dms", name.c_str(),
+		_instructionCount - instructionsWere, g_system->getMillis() - startTime);
 
 	// check the stack was left in a sane state
 	if (_registers[SREG_SP]._type != rvtStackPointer)
@@ -469,9 +517,294 @@ static InstructionInfo instructionInfo[NUM_INSTRUCTIONS + 1] = {
 
 static const char *regnames[] = { "null", "sp", "mar", "ax", "bx", "cx", "op", "dx" };
 
-#define MAX_FUNC_PARAMS 20 // maximum size of externalStack
+void ccScript::decodeInstructions() {
+	_instructions.clear();
+	_instructionIndex.clear();
+	_instructionIndex.resize(_code.size());
+	for (uint i = 0; i < _instructionIndex.size(); ++i)
+		_instructionIndex[i] = SCRIPT_NO_INSTRUCTION;
+
+	uint32 pc = 0;
+	while (pc < _code.size()) {
+		ScriptInstruction ins;
+		ins._offset = pc;
+		ins._opcode = 0;
+		ins._numArgs = 0;
+		ins._argFixupTypes[0] = ins._argFixupTypes[1] = FIXUP_NONE;
+		ins._args[0] = ins._args[1] = ins._args[2] = 0;
+		ins._jumpTarget = SCRIPT_NO_INSTRUCTION;
+		ins._problem = sipNone;
+		ins._problemArg = 0;
+
+		_instructionIndex[pc] = _instructions.size();
+
+		uint32 opcode = _code[pc]._data;
+		if (opcode > NUM_INSTRUCTIONS) {
+			// we can't know how long this is, so we can't decode anything after it
+			ins._problem = sipInvalidOpcode;
+			ins._args[0] = opcode;
+			_instructions.push_back(ins);
+			break;
+		}
+		const InstructionInfo &info = instructionInfo[opcode];
+		ins._opcode = opcode;
+		ins._numArgs = info.numArgs;
+		if (opcode == 0) {
+			ins._problem = sipInvalidOpcode;
+			ins._numArgs = 0;
+		}
+
+		if (pc + ins._numArgs >= _code.size()) {
+			ins._problem = sipMissingArgs;
+			_instructions.push_back(ins);
+			break;
+		}
+
+		for (uint v = 0; v < ins._numArgs; ++v) {
+			const ScriptCodeEntry &arg = _code[pc + 1 + v];
+			ins._args[v] = arg._data;
+			if (v >= 2)
+				continue;
+			ins._argFixupTypes[v] = arg._fixupType;
+
+			// string literals are immutable, so all uses can share one object
+			if (arg._fixupType == FIXUP_STRING && !_stringObjects.contains(arg._data))
+				_stringObjects[arg._data] = new ScriptConstString(Common::String((const char *)&_strings[arg._data]));
+
+			// sanity-check the argument
+			InstArgumentType argType = (v == 0) ? info.arg1Type : info.arg2Type;
+			if (argType == iatAny || ins._problem)
+				continue;
+			if (argType == iatNone)
+				error("internal inconsistency in argument type table");
+			if (arg._fixupType) {
+				ins._problem = sipUnexpectedFixup;
+				ins._problemArg = v;
+			} else if ((argType == iatRegister || argType == iatRegisterInt || argType == iatRegisterFloat)
+				&& arg._data >= CC_NUM_REGISTERS) {
+				ins._problem = sipInvalidRegister;
+				ins._problemArg = v;
+			}
+		}
+
+		_instructions.push_back(ins);
+		pc += 1 + ins._numArgs;
+	}
+
+	// terminate the list, in case the script runs off the end of the code
+	ScriptInstruction end;
+	end._offset = pc;
+	end._opcode = 0;
+	end._numArgs = 0;
+	end._argFixupTypes[0] = end._argFixupTypes[1] = FIXUP_NONE;
+	end._args[0] = end._args[1] = end._args[2] = 0;
+	end._jumpTarget = SCRIPT_NO_INSTRUCTION;
+	end._problem = sipEndOfCode;
+	end._problemArg = 0;
+	_instructions.push_back(end);
+
+	// resolve the jump targets
+	for (uint i = 0; i < _instructions.size(); ++i) {
+		ScriptInstruction &ins = _instructions[i];
+		if (ins._problem)
+			continue;
+		if (ins._opcode != SCMD_JZ && ins._opcode != SCMD_JNZ && ins._opcode != SCMD_JMP)
+			continue;
+		uint32 target = ins._offset + 1 + ins._numArgs + ins._args[0];
+		if (target < _instructionIndex.size())
+			ins._jumpTarget = _instructionIndex[target];
+	}
+
+	debug(3, "script has %d instructions", _instructions.size() - 1);
+}
+
+// Check the decoded instructions once at load time, so that the interpreter
+// doesn't need to check opcodes, arguments or jump targets as it runs.
+void ccScript::verifyInstructions() {
+	uint32 lineNumber = 0;
+
+	// (the last instruction is the end-of-code marker)
+	for (uint i = 0; i + 1 < _instructions.size(); ++i) {
+		const ScriptInstruction &ins = _instructions[i];
+		const InstructionInfo &info = instructionInfo[ins._opcode];
+
+		switch (ins._problem) {
+		case sipNone:
+			break;
+		case sipInvalidOpcode:
+			error("runCodeFrom(): invalid instruction %d", ins._opcode ? ins._opcode : ins._args[0]);
+		case sipMissingArgs:
+			error("runCodeFrom(): needed %d arguments for %s on line %d", ins._numArgs,
+				info.name, lineNumber);
+		case sipUnexpectedFixup:
+			error("expected integer for param %d of %s on line %d, got fixup (type %d)",
+				ins._problemArg + 1, info.name, lineNumber, ins._argFixupTypes[ins._problemArg]);
+		case sipInvalidRegister:
+			error("expected valid register for param %d of %s on line %d, got %d",
+				ins._problemArg + 1, info.name, lineNumber, ins._args[ins._problemArg]);
+		default:
+			error("internal inconsistency (instruction problem %d)", ins._problem);
+		}
+
+		switch (ins._opcode) {
+		case SCMD_LINENUM:
+			lineNumber = ins._args[0];
+			break;
+		case SCMD_JZ:
+		case SCMD_JNZ:
+		case SCMD_JMP:
+			if (ins._jumpTarget == SCRIPT_NO_INSTRUCTION)
+				error("runCodeFrom(): script tried to jump to an invalid address from %d on line %d", ins._offset, lineNumber);
+			break;
+		}
+	}
+}
+
 #define MAXNEST 50 // number of recursive function calls allowed
 
+void ccInstance::dumpInstruction(ccInstance *inst, const ScriptInstruction &ins) {
+	ccScript *script = inst->_script;
+	const InstructionInfo &info = instructionInfo[ins._opcode];
+
+	debugN(4, "%06d: %s", ins._offset, info.name);
+	for (uint v = 0; v < ins._numArgs && v < 2; ++v) {
+		InstArgumentType argType = (v == 0) ? info.arg1Type : info.arg2Type;
+		uint32 argValue = ins._args[v];
+
+		switch (ins._argFixupTypes[v]) {
+		case FIXUP_NONE:
+			if (argType == iatRegister || argType == iatRegisterInt || argType == iatRegisterFloat)
+				debugN(4, " %s", regnames[argValue]);
+			else
+				debugN(4, " %d", argValue);
+			break;
+		case FIXUP_GLOBALDATA:
+			debugN(4, " data@%d", argValue);
+			break;
+		case FIXUP_FUNCTION:
+			debugN(4, " func@%d", argValue);
+			break;
+		case FIXUP_STRING:
+			debugN(4, " string@%d\"%s\"", argValue, &script->_strings[argValue]);
+			break;
+		case FIXUP_IMPORT:
+			debugN(4, " import@%d:%s", argValue, script->_imports[argValue].c_str());
+			break;
+		case FIXUP_STACK:
+			debugN(4, " stack@%d", argValue);
+			break;
+		}
+	}
+	debug(4, " ");
+}
+
+uint32 ccInstance::getInstructionAt(ccInstance *inst, uint32 offset) {
+	const Common::Array<uint32> &index = inst->_script->_instructionIndex;
+
+	if (offset >= index.size() || index[offset] == SCRIPT_NO_INSTRUCTION)
+		error("runCodeFrom(): tried to continue at invalid address %d on line %d", offset, _lineNumber);
+	return index[offset];
+}
+
+RuntimeValue ccInstance::resolveArgument(ccInstance *inst, const ScriptInstruction &ins, uint arg) {
+	ccScript *script = inst->_script;
+	uint32 argValue = ins._args[arg];
+	RuntimeValue value = argValue;
+
+	switch (ins._argFixupTypes[arg]) {
+	case FIXUP_NONE:
+		break;
+	case FIXUP_GLOBALDATA:
+		value._type = rvtScriptData;
+		value._instance = inst;
+		// (note that you can't apply the fixup here, since we don't know the offset yet)
+		break;
+	case FIXUP_FUNCTION:
+		value._type = rvtFunction;
+		break;
+	case FIXUP_STRING:
+		value = script->_stringObjects[argValue];
+		break;
+	case FIXUP_IMPORT:
+		switch (inst->_resolvedImports[argValue]._type) {
+		case sitSystemFunction:
+			value._type = rvtSystemFunction;
+			value._function = inst->_resolvedImports[argValue]._function;
+			// preserve the import index for debugging purposes
+			value._value = argValue;
+			break;
+		case sitSystemObject:
+			value = inst->_resolvedImports[argValue]._object;
+			break;
+		case sitScriptFunction:
+			value._type = rvtScriptFunction;
+			value._value = inst->_resolvedImports[argValue]._offset;
+			value._instance = inst->_resolvedImports[argValue]._owner;
+			break;
+		case sitScriptData:
+			value._type = rvtScriptData;
+			value._value = inst->_resolvedImports[argValue]._offset;
+			value._instance = inst->_resolvedImports[argValue]._owner;
+			break;
+		default:
+			error("internal inconsistency (got import fixup with import type %d)", inst->_resolvedImports[argValue]._type);
+		}
+		break;
+	case FIXUP_STACK:
+		value._type = rvtStackPointer;
+		break;
+	case FIXUP_DATADATA:
+	default:
+		error("internal inconsistency (got fixup type %d)", ins._argFixupTypes[arg]);
+	}
+
+	return value;
+}
+
+// The interpreter uses direct-threaded dispatch (computed goto) where the
+// compiler supports it, and a plain switch otherwise. Define
+// AGS_VM_SWITCH_DISPATCH to always use the switch (e.g. to compare the two).
+#if defined(__GNUC__) && !defined(AGS_VM_SWITCH_DISPATCH)
+#define AGS_VM_THREADED_DISPATCH
+#endif
+
+// fetch the instruction at ip, and its arguments
+// (the code was verified at load time, so there's no need to check it here)
+#define VM_FETCH() \
+	do { \
+		ins = &instructions[ip]; \
+		_pc = ins->_offset; \
+		_instructionCount++; \
+		if (gDebugLevel >= 4) \
+			dumpInstruction(inst, *ins); \
+		int1 = (int)ins->_args[0]; \
+		int2 = (int)ins->_args[1]; \
+		nextIp = ip + 1; \
+	} while (0)
+
+// sanity-check the state after an instruction, and move on to the next one
+#define VM_ADVANCE() \
+	do { \
+		if (_registers[SREG_SP]._type != rvtStackPointer || _registers[SREG_SP]._value < 4 || _registers[SREG_SP]._value >= _stack.size()) \
+			error("runCodeFrom(): SP got clobbered (now type %d, value %d) on line %d", \
+				_registers[SREG_SP]._type, _registers[SREG_SP]._value, _lineNumber); \
+		ip = nextIp; \
+	} while (0)
+
+#ifdef AGS_VM_THREADED_DISPATCH
+// computed gotos are a GCC extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define VM_CASE(op) vm_##op
+#define VM_DISPATCH() goto *dispatchTable[ins->_opcode]
+#define VM_NEXT do { VM_ADVANCE(); VM_FETCH(); VM_DISPATCH(); } while (0)
+#define VM_RESTART do { VM_FETCH(); VM_DISPATCH(); } while (0)
+#else
+#define VM_CASE(op) case op
+#define VM_NEXT break
+#define VM_RESTART continue
+#endif
+
 void ccInstance::runCodeFrom(uint32 start) {
 	ccInstance *inst = _runningInst;
 	ccScript *script = inst->_script;
@@ -480,11 +813,14 @@ void ccInstance::runCodeFrom(uint32 start) {
 
 	assert(start < script->_code.size());
 	_pc = start;
-	const Common::Array<ScriptCodeEntry> &code = script->_code;
+	const ScriptInstruction *instructions = &script->_instructions[0];
+	uint32 ip = getInstructionAt(inst, start);
 
 	// this allows scripts to disable the loop iteration sanity check
 	uint32 loopIterationCheckDisabledCount = 0;
 
+	ScriptProfiler *profiler = _vm->getScriptProfiler();
+
 	Common::Stack<RuntimeValue> externalStack;
 	bool nextCallNeedsObject = false;
 	bool recoverFromCallAs = false;
@@ -495,138 +831,121 @@ void ccInstance::runCodeFrom(uint32 start) {
 	Common::Stack<uint32> currentStart;
 	currentStart.push(_pc);
 
-	while (true) {
-		uint32 instruction = code[_pc]._data;
-		if (instruction > NUM_INSTRUCTIONS)
-			error("runCodeFrom(): invalid instruction %d", instruction);
-		InstructionInfo &info = instructionInfo[instruction];
-
-		uint32 neededArgs = info.numArgs;
-		if (_pc + neededArgs >= code.size())
-			error("runCodeFrom(): needed %d arguments for %s on line %d", neededArgs,
-				info.name, _lineNumber);
-
-		debugN(4, "%06d: %s", _pc, info.name);
-
-		ScriptCodeEntry arg[2];
-		RuntimeValue argVal[2];
-
-		for (uint v = 0; v < neededArgs && v < 2; ++v) {
-			arg[v] = code[_pc + 1 + v];
-
-			// work out which argument type we're expecting
-			InstArgumentType argType = info.arg1Type;
-			if (v == 1)
-				argType = info.arg2Type;
-
-			argVal[v]._value = arg[v]._data;
-			uint32 argValue = arg[v]._data;
-			switch (arg[v]._fixupType) {
-			case FIXUP_NONE:
-				if (argType == iatRegister || argType == iatRegisterInt || argType == iatRegisterFloat)
-					debugN(4, " %s", regnames[argValue]);
-				else
-					debugN(4, " %d", argValue);
-				break;
-			case FIXUP_GLOBALDATA:
-				argVal[v]._type = rvtScriptData;
-				argVal[v]._instance = inst;
-				debugN(4, " data@%d", argValue);
-				// (note that you can't apply the fixup here, since we don't know the offset yet)
-				break;
-			case FIXUP_FUNCTION:
-				argVal[v]._type = rvtFunction;
-				debugN(4, " func@%d", argValue);
-				break;
-			case FIXUP_STRING:
-				argVal[v] = new ScriptConstString(Common::String((const char *)&script->_strings[argValue]));
-				argVal[v]._object->DecRef();
-				debugN(4, " string@%d\"%s\"", argValue, &script->_strings[argValue]);
-				break;
-			case FIXUP_IMPORT:
-				switch (inst->_resolvedImports[argValue]._type) {
-				case sitSystemFunction:
-					argVal[v]._type = rvtSystemFunction;
-					argVal[v]._function = inst->_resolvedImports[argValue]._function;
-					// preserve the import index for debugging purposes
-					argVal[v]._value = argValue;
-					break;
-				case sitSystemObject:
-					argVal[v] = inst->_resolvedImports[argValue]._object;
-					break;
-				case sitScriptFunction:
-					argVal[v]._type = rvtScriptFunction;
-					argVal[v]._value = inst->_resolvedImports[argValue]._offset;
-					argVal[v]._instance = inst->_resolvedImports[argValue]._owner;
-
-					// if the next instruction is a system call instruction (CALLEXT), change it to a script one instead
-					// TODO: this is what the original engine does, but can't we fix it up in CALLEXT instead?
-					if (code[_pc + v + 2]._data == SCMD_CALLEXT)
-						script->_code[_pc + v + 2]._data = SCMD_CALLAS;
-					break;
-				case sitScriptData:
-					argVal[v]._type = rvtScriptData;
-					argVal[v]._value = inst->_resolvedImports[argValue]._offset;
-					argVal[v]._instance = inst->_resolvedImports[argValue]._owner;
-					break;
-				default:
-					error("internal inconsistency (got import fixup with import type %d)", inst->_resolvedImports[argValue]._type);
-				}
-				debugN(4, " import@%d:%s", argValue, script->_imports[argValue].c_str());
-				break;
-			case FIXUP_STACK:
-				argVal[v]._type = rvtStackPointer;
-				debugN(4, " stack@%d", argValue);
-				break;
-			case FIXUP_DATADATA:
-			default:
-				error("internal inconsistency (got fixup type %d)", arg[v]._fixupType);
-			}
-
-			// sanity-check the argument we got
-			if (argType == iatAny)
-				continue;
-			if (argType == iatNone)
-				error("internal inconsistency in argument type table");
-			if (arg[v]._fixupType)
-				error("expected integer for param %d of %s on line %d, got fixup (type %d)",
-					v + 1, info.name, _lineNumber, arg[v]._fixupType);
-			if (argType == iatRegister && arg[v]._data >= _registers.size())
-				error("expected valid register for param %d of %s on line %d, got %d",
-					v + 1, info.name, _lineNumber, arg[v]._data);
-			// FIXME: check iatRegisterInt, iatRegisterFloat
-		}
-		debug(4, " ");
+	const ScriptInstruction *ins;
+	int32 int1, int2;
+	uint32 nextIp;
 
-		const RuntimeValue &val2 = argVal[1];
-		int32 int1 = (int)argVal[0]._value, int2 = (int)argVal[1]._value;
+	// temporary variables
+	RuntimeValue tempVal;
+	ScriptObject *tempObj;
+	ScriptString *tempStr1, *tempStr2;
+	ccScript *instScript;
 
-		// temporary variables
-		RuntimeValue tempVal;
-		ScriptObject *tempObj;
-		ScriptString *tempStr1, *tempStr2;
-		uint32 *fixup;
-		ccScript *instScript;
-		Common::Array<RuntimeValue> params;
+#ifdef AGS_VM_THREADED_DISPATCH
+	static const void *const dispatchTable[NUM_INSTRUCTIONS + 1] = {
+		&&vm_invalid,
+		&&vm_SCMD_ADD,
+		&&vm_SCMD_SUB,
+		&&vm_SCMD_REGTOREG,
+		&&vm_SCMD_WRITELIT,
+		&&vm_SCMD_RET,
+		&&vm_SCMD_LITTOREG,
+		&&vm_SCMD_MEMREAD,
+		&&vm_SCMD_MEMWRITE,
+		&&vm_SCMD_MULREG,
+		&&vm_SCMD_DIVREG,
+		&&vm_SCMD_ADDREG,
+		&&vm_SCMD_SUBREG,
+		&&vm_SCMD_BITAND,
+		&&vm_SCMD_BITOR,
+		&&vm_SCMD_ISEQUAL,
+		&&vm_SCMD_NOTEQUAL,
+		&&vm_SCMD_GREATER,
+		&&vm_SCMD_LESSTHAN,
+		&&vm_SCMD_GTE,
+		&&vm_SCMD_LTE,
+		&&vm_SCMD_AND,
+		&&vm_SCMD_OR,
+		&&vm_SCMD_CALL,
+		&&vm_SCMD_MEMREADB,
+		&&vm_SCMD_MEMREADW,
+		&&vm_SCMD_MEMWRITEB,
+		&&vm_SCMD_MEMWRITEW,
+		&&vm_SCMD_JZ,
+		&&vm_SCMD_PUSHREG,
+		&&vm_SCMD_POPREG,
+		&&vm_SCMD_JMP,
+		&&vm_SCMD_MUL,
+		&&vm_SCMD_CALLEXT,
+		&&vm_SCMD_PUSHREAL,
+		&&vm_SCMD_SUBREALSTACK,
+		&&vm_SCMD_LINENUM,
+		&&vm_SCMD_CALLAS,
+		&&vm_SCMD_THISBASE,
+		&&vm_SCMD_NUMFUNCARGS,
+		&&vm_SCMD_MODREG,
+		&&vm_SCMD_XORREG,
+		&&vm_SCMD_NOTREG,
+		&&vm_SCMD_SHIFTLEFT,
+		&&vm_SCMD_SHIFTRIGHT,
+		&&vm_SCMD_CALLOBJ,
+		&&vm_SCMD_CHECKBOUNDS,
+		&&vm_SCMD_MEMWRITEPTR,
+		&&vm_SCMD_MEMREADPTR,
+		&&vm_SCMD_MEMZEROPTR,
+		&&vm_SCMD_MEMINITPTR,
+		&&vm_SCMD_LOADSPOFFS,
+		&&vm_SCMD_CHECKNULL,
+		&&vm_SCMD_FADD,
+		&&vm_SCMD_FSUB,
+		&&vm_SCMD_FMULREG,
+		&&vm_SCMD_FDIVREG,
+		&&vm_SCMD_FADDREG,
+		&&vm_SCMD_FSUBREG,
+		&&vm_SCMD_FGREATER,
+		&&vm_SCMD_FLESSTHAN,
+		&&vm_SCMD_FGTE,
+		&&vm_SCMD_FLTE,
+		&&vm_SCMD_ZEROMEMORY,
+		&&vm_SCMD_CREATESTRING,
+		&&vm_SCMD_STRINGSEQUAL,
+		&&vm_SCMD_STRINGSNOTEQ,
+		&&vm_SCMD_CHECKNULLREG,
+		&&vm_SCMD_LOOPCHECKOFF,
+		&&vm_SCMD_MEMZEROPTRND,
+		&&vm_SCMD_JNZ,
+		&&vm_SCMD_DYNAMICBOUNDS,
+		&&vm_SCMD_NEWARRAY
+	};
+
+	VM_FETCH();
+	VM_DISPATCH();
+	{
+#else
+	while (true) {
+		VM_FETCH();
 
-		switch (instruction) {
-		case SCMD_LINENUM:
+		switch (ins->_opcode) {
+#endif
+		VM_CASE(SCMD_LINENUM):
 			// debug info - source code line number
 			_lineNumber = int1;
-			break;
-		case SCMD_ADD:
+			if (profiler)
+				profiler->setLine(_pc, _lineNumber, _instructionCount);
+			VM_NEXT;
+		VM_CASE(SCMD_ADD):
 			// reg1 += arg2
 			_registers[int1]._signedValue += int2;
-			break;
-		case SCMD_SUB:
+			VM_NEXT;
+		VM_CASE(SCMD_SUB):
 			// reg1 -= arg2
 			_registers[int1]._signedValue -= int2;
-			break;
-		case SCMD_REGTOREG:
+			VM_NEXT;
+		VM_CASE(SCMD_REGTOREG):
 			// reg2 = reg1;
 			_registers[int2] = _registers[int1];
-			break;
-		case SCMD_WRITELIT:
+			VM_NEXT;
+		VM_CASE(SCMD_WRITELIT):
 			// m[MAR] = arg2 (copy arg1 bytes)
 			// "poss something dodgy about this routine"
 			// But, conveniently, this should only ever be used to write 4-byte null pointers.
@@ -635,19 +954,18 @@ void ccInstance::runCodeFrom(uint32 start) {
 				if (int1 > 4 || int2 != 0)
 					error("script tried using WRITELIT unsafely on stack (%d bytes of %d) on line %d",
 						int1, int2, _lineNumber);
-				// FIXME: check bounds
-				_stack[_registers[SREG_MAR]._value] = 0;
-				// TODO: good?
-				for (uint i = 1; i < (uint)int1; ++i)
-					_stack[i + _registers[SREG_MAR]._value].invalidate();
-				break;
+				if (_registers[SREG_MAR]._value + 4 > _stack.size())
+					error("script tried to WRITELIT to out-of-bounds stack@%d on line %d",
+						_registers[SREG_MAR]._value, _lineNumber);
+				writeStack(_registers[SREG_MAR]._value, RuntimeValue());
+				VM_NEXT;
 			}
 			if (int1 != 4 || int2 != 0)
 				error("script tried using WRITELIT unsafely (%d bytes of %d) on line %d",
 					int1, int2, _lineNumber);
 			writePointer(_registers[SREG_MAR], NULL);
-			break;
-		case SCMD_RET:
+			VM_NEXT;
+		VM_CASE(SCMD_RET):
 			// return from subroutine
 
 			// only sabotage the sanity check until returning from the function which disabled it
@@ -656,6 +974,8 @@ void ccInstance::runCodeFrom(uint32 start) {
 
 			// pop return address
 			_pc = popIntValue();
+			if (profiler)
+				profiler->leaveFunction(_instructionCount);
 			if (_pc == 0) {
 				debug(4, "(returning to caller)");
 				_returnValue = _registers[SREG_AX];
@@ -668,26 +988,29 @@ void ccInstance::runCodeFrom(uint32 start) {
 			// TODO: restore call stack (line number etc)
 
 			// continue so that the PC doesn't get overwritten
-			continue;
-		case SCMD_LITTOREG:
+			ip = getInstructionAt(inst, _pc);
+			VM_RESTART;
+		VM_CASE(SCMD_LITTOREG):
 			// set reg1 to literal value arg2
-			_registers[int1] = val2;
-			break;
-		case SCMD_MEMREAD:
+			if (ins->_argFixupTypes[1] == FIXUP_NONE)
+				_registers[int1] = (uint32)int2;
+			else
+				_registers[int1] = resolveArgument(inst, *ins, 1);
+			VM_NEXT;
+		VM_CASE(SCMD_MEMREAD):
 			// reg1 = m[MAR]
 			tempVal = _registers[SREG_MAR];
 			switch (tempVal._type) {
 			case rvtScriptData:
 				// FIXME: bounds checks
 				instScript = tempVal._instance->_script;
-				if (tempVal._instance->_globalObjects->contains(tempVal._value)) {
+				if (tempVal._instance->hasGlobalObject(tempVal._value)) {
 					// resolves to an object
 					_registers[int1] = (*tempVal._instance->_globalObjects)[tempVal._value];
 					break;
 				}
-				fixup = Common::find(instScript->_globalFixups.begin(), instScript->_globalFixups.end(), tempVal._value);
 				_registers[int1] = READ_LE_UINT32(&(*tempVal._instance->_globalData)[tempVal._value]);
-				if (fixup != instScript->_globalFixups.end()) {
+				if (instScript->isGlobalFixup(tempVal._value)) {
 					// this resolves to another offset!
 					_registers[int1].invalidate();
 					_registers[int1]._type = rvtScriptData;
@@ -701,40 +1024,38 @@ void ccInstance::runCodeFrom(uint32 start) {
 				if (tempVal._value + 4 >= _stack.size())
 					error("script tried to MEMREAD from out-of-bounds stack@%d on line %d",
 						tempVal._value, _lineNumber);
-				if (_stack[tempVal._value]._type == rvtInvalid)
+				if (_stackTypes[tempVal._value] == rvtInvalid)
 					error("script tried to MEMREAD from invalid stack@%d on line %d",
 						tempVal._value, _lineNumber);
 				// TODO: make sure the other stack entries didn't get prodded at in the meantime
-				_registers[int1] = _stack[tempVal._value];
+				_registers[int1] = readStack(tempVal._value);
 				break;
 			default:
 				error("script tried to MEMREAD from runtime value of type %d (value %d) on line %d",
 					tempVal._type, tempVal._value, _lineNumber);
 			}
-			break;
-		case SCMD_MEMWRITE:
+			VM_NEXT;
+		VM_CASE(SCMD_MEMWRITE):
 			// m[MAR] = reg1
 			tempVal = _registers[SREG_MAR];
 			switch (tempVal._type) {
 			case rvtScriptData:
 				// FIXME: bounds checks
 				instScript = tempVal._instance->_script;
-				fixup = Common::find(instScript->_globalFixups.begin(), instScript->_globalFixups.end(), tempVal._value);
-				if (fixup != instScript->_globalFixups.end())
+				if (instScript->isGlobalFixup(tempVal._value))
 					error("script tried to MEMWRITE script data at %d with a fixup on line %d",
 						tempVal._value, _lineNumber);
 				if (_registers[int1]._type == rvtSystemObject) {
 					// writing an object to script global data
 					WRITE_LE_UINT32(&(*tempVal._instance->_globalData)[tempVal._value], 0);
-					(*tempVal._instance->_globalObjects)[tempVal._value] = _registers[int1];
+					tempVal._instance->setGlobalObject(tempVal._value, _registers[int1]);
 					break;
 				}
 				// FIXME: agh, float horror
 				if (_registers[int1]._type != rvtInteger && _registers[int1]._type != rvtFloat)
 					error("script tried to MEMWRITE runtime value of type %d (value %d) on line %d",
 						_registers[int1]._type, _registers[int1]._value, _lineNumber);
-				if (tempVal._instance->_globalObjects->contains(tempVal._value))
-					tempVal._instance->_globalObjects->erase(tempVal._value);
+				tempVal._instance->removeGlobalObject(tempVal._value);
 				WRITE_LE_UINT32(&(*tempVal._instance->_globalData)[tempVal._value], _registers[int1]._value);
 				break;
 			case rvtSystemObject:
@@ -749,97 +1070,94 @@ void ccInstance::runCodeFrom(uint32 start) {
 				if (tempVal._value + 4 >= _stack.size())
 					error("script tried to MEMWRITE to out-of-bounds stack@%d on line %d",
 						tempVal._value, _lineNumber);
-				_stack[tempVal._value] = _registers[int1];
-				_stack[tempVal._value + 1].invalidate();
-				_stack[tempVal._value + 2].invalidate();
-				_stack[tempVal._value + 3].invalidate();
+				writeStack(tempVal._value, _registers[int1]);
 				break;
 			default:
 				error("script tried to MEMWRITE to runtime value of type %d (value %d) on line %d",
 					tempVal._type, tempVal._value, _lineNumber);
 			}
-			break;
-		case SCMD_LOADSPOFFS:
+			VM_NEXT;
+		VM_CASE(SCMD_LOADSPOFFS):
 			// MAR = SP - arg1 (optimization for local var access)
 			_registers[SREG_MAR] = _registers[SREG_SP];
 			if ((uint32)int1 > _registers[SREG_SP]._value)
 				error("load.sp.offs tried going %d back in a stack of size %d on line %d",
 					int1, _registers[SREG_SP]._value, _lineNumber);
 			_registers[SREG_MAR]._value -= int1;
-			break;
-		case SCMD_MULREG:
+			VM_NEXT;
+		VM_CASE(SCMD_MULREG):
 			// reg1 *= reg2
 			_registers[int1]._signedValue *= _registers[int2]._signedValue;
-			break;
-		case SCMD_DIVREG:
+			VM_NEXT;
+		VM_CASE(SCMD_DIVREG):
 			// reg1 /= reg2
 			if (_registers[int2]._signedValue == 0)
 				error("script tried to divide by zero on line %d", _lineNumber);
 			_registers[int1]._signedValue /= _registers[int2]._signedValue;
-			break;
-		case SCMD_ADDREG:
+			VM_NEXT;
+		VM_CASE(SCMD_ADDREG):
 			// reg1 += reg2
 			_registers[int1]._signedValue += _registers[int2]._signedValue;
-			break;
-		case SCMD_SUBREG:
+			VM_NEXT;
+		VM_CASE(SCMD_SUBREG):
 			// reg1 -= reg2
 			_registers[int1]._signedValue -= _registers[int2]._signedValue;
-			break;
-		case SCMD_BITAND:
+			VM_NEXT;
+		VM_CASE(SCMD_BITAND):
 			// reg1 &= reg2
 			_registers[int1]._value &= _registers[int2]._value;
-			break;
-		case SCMD_BITOR:
+			VM_NEXT;
+		VM_CASE(SCMD_BITOR):
 			// reg1 |= reg2
 			_registers[int1]._value |= _registers[int2]._value;
-			break;
-		case SCMD_ISEQUAL:
+			VM_NEXT;
+		VM_CASE(SCMD_ISEQUAL):
 			// reg1 == reg2   reg1=1 if true, =0 if not
 			_registers[int1] = _registers[int1].equalTo(_registers[int2]) ? 1 : 0;
-			break;
-		case SCMD_NOTEQUAL:
+			VM_NEXT;
+		VM_CASE(SCMD_NOTEQUAL):
 			// reg1 != reg2
 			_registers[int1] = _registers[int1].equalTo(_registers[int2]) ? 0 : 1;
-			break;
-		case SCMD_GREATER:
+			VM_NEXT;
+		VM_CASE(SCMD_GREATER):
 			// reg1 > reg2
 			_registers[int1] = (_registers[int1]._signedValue > _registers[int2]._signedValue) ? 1 : 0;
-			break;
-		case SCMD_LESSTHAN:
+			VM_NEXT;
+		VM_CASE(SCMD_LESSTHAN):
 			// reg1 < reg2
 			_registers[int1] = (_registers[int1]._signedValue < _registers[int2]._signedValue) ? 1 : 0;
-			break;
-		case SCMD_GTE:
+			VM_NEXT;
+		VM_CASE(SCMD_GTE):
 			// reg1 >= reg2
 			_registers[int1] = (_registers[int1]._signedValue >= _registers[int2]._signedValue) ? 1 : 0;
-			break;
-		case SCMD_LTE:
+			VM_NEXT;
+		VM_CASE(SCMD_LTE):
 			// reg1 <= reg2
 			_registers[int1] = (_registers[int1]._signedValue <= _registers[int2]._signedValue) ? 1 : 0;
-			break;
-		case SCMD_AND:
+			VM_NEXT;
+		VM_CASE(SCMD_AND):
 			// (reg1!=0) && (reg2!=0) -> reg1
 			_registers[int1] = (_registers[int1]._value && _registers[int2]._value) ? 1 : 0;
-			break;
-		case SCMD_OR:
+			VM_NEXT;
+		VM_CASE(SCMD_OR):
 			// (reg1!=0) || (reg2!=0) -> reg1
 			_registers[int1] = (_registers[int1]._value || _registers[int2]._value) ? 1 : 0;
-			break;
-		case SCMD_XORREG:
+			VM_NEXT;
+		VM_CASE(SCMD_XORREG):
 			// reg1 ^= reg2
 			_registers[int1]._value ^= _registers[int2]._value;
-			break;
-		case SCMD_MODREG:
+			VM_NEXT;
+		VM_CASE(SCMD_MODREG):
 			// reg1 %= reg2
 			if (_registers[int2]._value == 0)
 				error("script tried to divide (modulo) by zero on line %d", _lineNumber);
 			_registers[int1]._value %= _registers[int2]._value;
-			break;
-		case SCMD_NOTREG:
+			VM_NEXT;
+		VM_CASE(SCMD_NOTREG):
 			// reg1 = !reg1
 			_registers[int1]._value = !_registers[int1]._value;
-			break;
-		case SCMD_CALL:
+			VM_NEXT;
+		VM_CASE(SCMD_CALL):
 			// jump to subroutine at reg1
 			if (_registers[int1]._type != rvtFunction)
 				error("script tried to CALL non-function runtime value of type %d (value %d) on line %d",
@@ -851,7 +1169,7 @@ void ccInstance::runCodeFrom(uint32 start) {
 			// TODO: store call stack (line number etc)
 
 			// push return value onto stack
-			pushValue(_pc + neededArgs + 1);
+			pushValue(_pc + ins->_numArgs + 1);
 
 			_pc = _registers[int1]._value;
 			if (currentBase.top() != 0) {
@@ -868,8 +1186,11 @@ void ccInstance::runCodeFrom(uint32 start) {
 
 			currentBase.push(0);
 			currentStart.push(_pc);
-			break;
-		case SCMD_MEMREADB:
+			if (profiler)
+				profiler->enterFunction(script, _pc, _instructionCount);
+			nextIp = getInstructionAt(inst, _pc + ins->_numArgs + 1);
+			VM_NEXT;
+		VM_CASE(SCMD_MEMREADB):
 			// reg1 = m[MAR] (1 byte)
 			tempVal = _registers[SREG_MAR];
 			// FIXME: check range?
@@ -877,10 +1198,9 @@ void ccInstance::runCodeFrom(uint32 start) {
 			case rvtScriptData:
 				// FIXME: bounds checks
 				instScript = tempVal._instance->_script;
-				if (tempVal._instance->_globalObjects->contains(tempVal._value))
+				if (tempVal._instance->hasGlobalObject(tempVal._value))
 					error("script tried MEMREADB on object on line %d", _lineNumber);
-				fixup = Common::find(instScript->_globalFixups.begin(), instScript->_globalFixups.end(), tempVal._value);
-				if (fixup != instScript->_globalFixups.end())
+				if (instScript->isGlobalFixup(tempVal._value))
 					error("script tried MEMREADB on fixup on line %d", _lineNumber);
 				_registers[int1] = (byte)(*tempVal._instance->_globalData)[tempVal._value];
 				break;
@@ -891,17 +1211,17 @@ void ccInstance::runCodeFrom(uint32 start) {
 				if (tempVal._value + 2 >= _stack.size())
 					error("script tried to MEMREADB from out-of-bounds stack@%d on line %d",
 						tempVal._value, _lineNumber);
-				if (_stack[tempVal._value]._type != rvtInteger)
+				if (!isStackInteger(tempVal._value))
 					error("script tried to MEMREADB from invalid stack@%d on line %d",
 						tempVal._value, _lineNumber);
-				_registers[int1] = (byte)_stack[tempVal._value]._value;
+				_registers[int1] = _stack[tempVal._value];
 				break;
 			default:
 				error("script tried to MEMREADB from runtime value of type %d (value %d) on line %d",
 					tempVal._type, tempVal._value, _lineNumber);
 			}
-			break;
-		case SCMD_MEMREADW:
+			VM_NEXT;
+		VM_CASE(SCMD_MEMREADW):
 			// reg1 = m[MAR] (2 bytes)
 			tempVal = _registers[SREG_MAR];
 			// FIXME: check range?
@@ -909,10 +1229,9 @@ void ccInstance::runCodeFrom(uint32 start) {
 			case rvtScriptData:
 				// FIXME: bounds checks
 				instScript = tempVal._instance->_script;
-				if (tempVal._instance->_globalObjects->contains(tempVal._value))
+				if (tempVal._instance->hasGlobalObject(tempVal._value))
 					error("script tried MEMREADW on object on line %d", _lineNumber);
-				fixup = Common::find(instScript->_globalFixups.begin(), instScript->_globalFixups.end(), tempVal._value);
-				if (fixup != instScript->_globalFixups.end())
+				if (instScript->isGlobalFixup(tempVal._value))
 					error("script tried MEMREADW on fixup on line %d", _lineNumber);
 				_registers[int1] = (int16)READ_LE_UINT16(&(*tempVal._instance->_globalData)[tempVal._value]);
 				break;
@@ -923,17 +1242,17 @@ void ccInstance::runCodeFrom(uint32 start) {
 				if (tempVal._value + 2 >= _stack.size())
 					error("script tried to MEMREADW from out-of-bounds stack@%d on line %d",
 						tempVal._value, _lineNumber);
-				if (_stack[tempVal._value]._type != rvtInteger)
+				if (!isStackInteger(tempVal._value))
 					error("script tried to MEMREADW from invalid stack@%d on line %d",
 						tempVal._value, _lineNumber);
-				_registers[int1] = (int16)_stack[tempVal._value]._value;
+				_registers[int1] = (int16)READ_LE_UINT16(&_stack[tempVal._value]);
 				break;
 			default:
 				error("script tried to MEMREADW from runtime value of type %d (value %d) on line %d",
 					tempVal._type, tempVal._value, _lineNumber);
 			}
-			break;
-		case SCMD_MEMWRITEB:
+			VM_NEXT;
+		VM_CASE(SCMD_MEMWRITEB):
 			// m[MAR] = reg1 (1 byte)
 			tempVal = _registers[SREG_MAR];
 			if (_registers[int1]._type != rvtInteger)
@@ -944,11 +1263,9 @@ void ccInstance::runCodeFrom(uint32 start) {
 			case rvtScriptData:
 				// FIXME: bounds checks
 				instScript = tempVal._instance->_script;
-				fixup = Common::find(instScript->_globalFixups.begin(), instScript->_globalFixups.end(), tempVal._value);
-				if (fixup != instScript->_globalFixups.end())
+				if (instScript->isGlobalFixup(tempVal._value))
 					error("script tried MEMWRITEB on fixup on %d", _lineNumber);
-				if (tempVal._instance->_globalObjects->contains(tempVal._value))
-					tempVal._instance->_globalObjects->erase(tempVal._value);
+				tempVal._instance->removeGlobalObject(tempVal._value);
 				(*tempVal._instance->_globalData)[tempVal._value] = (byte)_registers[int1]._value;
 				break;
 			case rvtSystemObject:
@@ -960,14 +1277,14 @@ void ccInstance::runCodeFrom(uint32 start) {
 				if (tempVal._value + 1 >= _stack.size())
 					error("script tried to MEMWRITEB to out-of-bounds stack@%d on line %d",
 						tempVal._value, _lineNumber);
-				_stack[tempVal._value] = (byte)_registers[int1]._value;
+				writeStack(tempVal._value, (uint32)(byte)_registers[int1]._value, 1);
 				break;
 			default:
 				error("script tried to MEMWRITEB to runtime value of type %d (value %d) on line %d",
 					tempVal._type, tempVal._value, _lineNumber);
 			}
-			break;
-		case SCMD_MEMWRITEW:
+			VM_NEXT;
+		VM_CASE(SCMD_MEMWRITEW):
 			// m[MAR] = reg1 (2 bytes)
 			tempVal = _registers[SREG_MAR];
 			if (_registers[int1]._type != rvtInteger)
@@ -978,11 +1295,9 @@ void ccInstance::runCodeFrom(uint32 start) {
 			case rvtScriptData:
 				// FIXME: bounds checks
 				instScript = tempVal._instance->_script;
-				fixup = Common::find(instScript->_globalFixups.begin(), instScript->_globalFixups.end(), tempVal._value);
-				if (fixup != instScript->_globalFixups.end())
+				if (instScript->isGlobalFixup(tempVal._value))
 					error("script tried MEMWRITEW on fixup on %d", _lineNumber);
-				if (tempVal._instance->_globalObjects->contains(tempVal._value))
-					tempVal._instance->_globalObjects->erase(tempVal._value);
+				tempVal._instance->removeGlobalObject(tempVal._value);
 				WRITE_LE_UINT16(&(*tempVal._instance->_globalData)[tempVal._value], (int16)_registers[int1]._value);
 				break;
 			case rvtSystemObject:
@@ -994,61 +1309,60 @@ void ccInstance::runCodeFrom(uint32 start) {
 				if (tempVal._value + 2 >= _stack.size())
 					error("script tried to MEMWRITEW to out-of-bounds stack@%d on line %d",
 						tempVal._value, _lineNumber);
-				_stack[tempVal._value] = (int16)_registers[int1]._value;
-				_stack[tempVal._value + 1].invalidate();
+				writeStack(tempVal._value, (uint32)(uint16)_registers[int1]._value, 2);
 				break;
 			default:
 				error("script tried to MEMWRITEW to runtime value of type %d (value %d) on line %d",
 					tempVal._type, tempVal._value, _lineNumber);
 			}
-			break;
-		case SCMD_JZ:
+			VM_NEXT;
+		VM_CASE(SCMD_JZ):
 			// jump if ax==0 by arg1
 			if (_registers[SREG_AX]._type != rvtInteger && _registers[SREG_AX]._type != rvtFloat)
-				break;
+				VM_NEXT;
 			if (_registers[SREG_AX]._type == rvtFloat && _registers[SREG_AX]._floatValue != 0.0f)
-				break;
+				VM_NEXT;
 			if (_registers[SREG_AX]._type == rvtInteger && _registers[SREG_AX]._value != 0)
-				break;
-			_pc += int1;
-			break;
-		case SCMD_JNZ:
+				VM_NEXT;
+			nextIp = ins->_jumpTarget;
+			VM_NEXT;
+		VM_CASE(SCMD_JNZ):
 			// jump by arg1 if ax!=0
 			if (_registers[SREG_AX]._type == rvtFloat && _registers[SREG_AX]._floatValue == 0.0f)
-				break;
+				VM_NEXT;
 			if (_registers[SREG_AX]._type == rvtInteger && _registers[SREG_AX]._value == 0)
-				break;
-			_pc += int1;
-			break;
-		case SCMD_PUSHREG:
+				VM_NEXT;
+			nextIp = ins->_jumpTarget;
+			VM_NEXT;
+		VM_CASE(SCMD_PUSHREG):
 			// m[sp]=reg1; sp++
 			pushValue(_registers[int1]);
-			break;
-		case SCMD_POPREG:
+			VM_NEXT;
+		VM_CASE(SCMD_POPREG):
 			// sp--; reg1=m[sp]
 			_registers[int1] = popValue();
-			break;
-		case SCMD_JMP:
-			_pc += int1;
+			VM_NEXT;
+		VM_CASE(SCMD_JMP):
+			nextIp = ins->_jumpTarget;
 			// check whether the script is stuck in a loop
 			if (loopIterationCheckDisabledCount)
-				break;
+				VM_NEXT;
 			if (int1 > 0)
-				break;
+				VM_NEXT;
 			// FIXME: make sure the script isn't stuck in a loop
-			break;
-		case SCMD_MUL:
+			VM_NEXT;
+		VM_CASE(SCMD_MUL):
 			// reg1 *= arg2
 			_registers[int1]._signedValue *= int2;
-			break;
-		case SCMD_CHECKBOUNDS:
+			VM_NEXT;
+		VM_CASE(SCMD_CHECKBOUNDS):
 			// check reg1 is between 0 and arg2
 			if (_registers[int1]._type != rvtInteger)
 				error("script error: checkbounds got value of type %d (not integer)", _registers[int1]._type);
 			if (_registers[int1]._value >= (uint32)int2)
 				error("script error: checkbounds value %d was not in range 0 to %d", _registers[int1]._value, int2);
-			break;
-		case SCMD_DYNAMICBOUNDS:
+			VM_NEXT;
+		VM_CASE(SCMD_DYNAMICBOUNDS):
 			// this is a bounds check
 			tempObj = getObjectFrom(_registers[SREG_MAR]);
 			assert(tempObj->isOfType(sotDynamicArray));
@@ -1058,16 +1372,21 @@ void ccInstance::runCodeFrom(uint32 start) {
 				if (offset < 0 || (uint)offset >= da->getMaxOffset())
 					error("script error: dynamic bounds value %d was not in range 0 to %d", offset, da->getMaxOffset());
 			}
-			break;
-		case SCMD_MEMREADPTR:
+			VM_NEXT;
+		VM_CASE(SCMD_MEMREADPTR):
 			// reg1 = m[MAR] (adjust ptr addr)
-			tempObj = getObjectFrom(_registers[SREG_MAR]);
+			if (_registers[SREG_MAR]._type == rvtSystemObject && _registers[SREG_MAR]._object->isOfType(sotDynamicArray)
+				&& ((ScriptDynamicArray *)_registers[SREG_MAR]._object)->isManaged()) {
+				// MAR points into the storage of a managed array
+				tempObj = ((ScriptDynamicArray *)_registers[SREG_MAR]._object)->getObject(_registers[SREG_MAR]._value);
+			} else
+				tempObj = getObjectFrom(_registers[SREG_MAR]);
 			if (tempObj)
 				_registers[int1] = tempObj;
 			else
 				_registers[int1] = 0;
-			break;
-		case SCMD_MEMWRITEPTR:
+			VM_NEXT;
+		VM_CASE(SCMD_MEMWRITEPTR):
 			// m[MAR] = reg1 (adjust ptr addr)
 			tempObj = NULL;
 			if (_registers[int1]._type != rvtInteger || _registers[int1]._value != 0) {
@@ -1077,8 +1396,8 @@ void ccInstance::runCodeFrom(uint32 start) {
 						_registers[int1]._type, _registers[int1]._value, _lineNumber);
 			}
 			writePointer(_registers[SREG_MAR], tempObj);
-			break;
-		case SCMD_MEMINITPTR:
+			VM_NEXT;
+		VM_CASE(SCMD_MEMINITPTR):
 			// m[MAR] = reg1 (but don't free old one)
 			tempObj = NULL;
 			if (_registers[int1]._type != rvtInteger || _registers[int1]._value != 0) {
@@ -1088,30 +1407,88 @@ void ccInstance::runCodeFrom(uint32 start) {
 						_registers[int1]._type, _registers[int1]._value, _lineNumber);
 			}
 			writePointer(_registers[SREG_MAR], tempObj);
-			break;
-		case SCMD_MEMZEROPTR:
+			VM_NEXT;
+		VM_CASE(SCMD_MEMZEROPTR):
 			// m[MAR] = 0    (blank ptr)
 			writePointer(_registers[SREG_MAR], NULL);
-			break;
-		case SCMD_MEMZEROPTRND:
+			VM_NEXT;
+		VM_CASE(SCMD_MEMZEROPTRND):
 			// m[MAR] = 0    (blank ptr, no dispose if = ax)
 			writePointer(_registers[SREG_MAR], NULL);
-			break;
-		case SCMD_CHECKNULL:
+			VM_NEXT;
+		VM_CASE(SCMD_CHECKNULL):
 			// error if MAR==0
 			if (_registers[SREG_MAR]._type == rvtInteger && _registers[SREG_MAR]._value == 0)
 				error("script tried to dereference null pointer on line %d", _lineNumber);
-			break;
-		case SCMD_CHECKNULLREG:
+			VM_NEXT;
+		VM_CASE(SCMD_CHECKNULLREG):
 			// error if reg1 == NULL
 			if (_registers[int1]._type == rvtInteger && _registers[int1]._value == 0)
 				error("script tried to dereference null pointer on line %d", _lineNumber);
-			break;
-		case SCMD_NUMFUNCARGS:
+			VM_NEXT;
+		VM_CASE(SCMD_NUMFUNCARGS):
 			// setfuncargs: number of arguments for ext func call
 			funcArgumentCount = int1;
-			break;
-		case SCMD_CALLAS:
+			VM_NEXT;
+		VM_CASE(SCMD_CALLEXT):
+			// farcall: call external (imported) function reg1
+			if (_registers[int1]._type != rvtScriptFunction) {
+				if (_registers[int1]._type != rvtSystemFunction)
+					error("script tried to CALLEXT non-system-function runtime value of type %d (value %d) on line %d",
+						_registers[int1]._type, _registers[int1]._value, _lineNumber);
+				debug(3, "calling external function '%s'", script->_imports[_registers[int1]._value].c_str());
+
+				recoverFromCallAs = false;
+				if (funcArgumentCount == (uint)-1)
+					funcArgumentCount = externalStack.size();
+				if (funcArgumentCount > externalStack.size())
+					error("script tried to CALLEXT with %d parameters, but there were only %d on line %d",
+						funcArgumentCount, externalStack.size(), _lineNumber);
+
+				// construct the parameter list (in reverse order), reusing
+				// the list from the last call at this depth
+				if (_paramDepth == _paramBuffers.size()) {
+					_paramBuffers.push_back(new Common::Array<RuntimeValue>());
+					_paramBuffers.back()->reserve(MAX_FUNC_PARAMS);
+				}
+				Common::Array<RuntimeValue> &params = *_paramBuffers[_paramDepth++];
+				for (uint i = 0; i < funcArgumentCount; ++i)
+					params.push_back(externalStack[externalStack.size() - i - 1]);
+
+				if (profiler)
+					profiler->enterSystemFunction(_registers[int1]._function->info, _instructionCount);
+
+				if (nextCallNeedsObject) {
+					if (_registers[SREG_OP]._type != rvtSystemObject)
+						error("script tried to CALLEXT on non-system-object runtime value of type %d (value %d) on line %d",
+							tempVal._type, tempVal._value, _lineNumber);
+					uint32 offset = _registers[SREG_OP]._value;
+					ScriptObject *object = _registers[SREG_OP]._object->getObjectAt(offset);
+					if (offset != 0)
+						error("script tried to CALLEXT on system-object with offset %d (resolved to %d) on line %d",
+							_registers[SREG_OP]._value, offset, _lineNumber);
+
+					_registers[SREG_AX] = callImportedFunction(_registers[int1]._function, object, params);
+				} else {
+					_registers[SREG_AX] = callImportedFunction(_registers[int1]._function, NULL, params);
+				}
+
+				if (profiler)
+					profiler->leaveSystemFunction(_instructionCount);
+
+				while (!params.empty())
+					params.pop_back();
+				_paramDepth--;
+
+				// TODO: unfinished
+				funcArgumentCount = (uint)-1;
+				nextCallNeedsObject = false;
+				VM_NEXT;
+			}
+			// the original engine patches the code to call imported script
+			// functions with CALLAS instead, so just do that here
+			// (fallthrough)
+		VM_CASE(SCMD_CALLAS):
 			// $callscr: call external script function
 			{
 			if (_registers[int1]._type != rvtScriptFunction)
@@ -1141,6 +1518,8 @@ void ccInstance::runCodeFrom(uint32 start) {
 
 			// call the script function
 			_runningInst = _registers[int1]._instance;
+			if (profiler)
+				profiler->enterFunction(_runningInst->_script, _registers[int1]._value, _instructionCount);
 			runCodeFrom(_registers[int1]._value);
 
 			if (_registers[SREG_SP]._value != oldsp)
@@ -1155,49 +1534,14 @@ void ccInstance::runCodeFrom(uint32 start) {
 			funcArgumentCount = (uint)-1;
 			nextCallNeedsObject = false;
 			}
-			break;
-		case SCMD_CALLEXT:
-			// farcall: call external (imported) function reg1
-			if (_registers[int1]._type != rvtSystemFunction)
-				error("script tried to CALLEXT non-system-function runtime value of type %d (value %d) on line %d",
-					_registers[int1]._type, _registers[int1]._value, _lineNumber);
-			debug(3, "calling external function '%s'", script->_imports[_registers[int1]._value].c_str());
-
-			recoverFromCallAs = false;
-			if (funcArgumentCount == (uint)-1)
-				funcArgumentCount = externalStack.size();
-
-			// construct the parameter list (in reverse order)
-			params.resize(funcArgumentCount);
-			for (uint i = 0; i < funcArgumentCount; ++i)
-				params[i] = externalStack[externalStack.size() - i - 1];
-
-			if (nextCallNeedsObject) {
-				if (_registers[SREG_OP]._type != rvtSystemObject)
-					error("script tried to CALLEXT on non-system-object runtime value of type %d (value %d) on line %d",
-						tempVal._type, tempVal._value, _lineNumber);
-				uint32 offset = _registers[SREG_OP]._value;
-				ScriptObject *object = _registers[SREG_OP]._object->getObjectAt(offset);
-				if (offset != 0)
-					error("script tried to CALLEXT on system-object with offset %d (resolved to %d) on line %d",
-						_registers[SREG_OP]._value, offset, _lineNumber);
-
-				_registers[SREG_AX] = callImportedFunction(_registers[int1]._function, object, params);
-			} else {
-				_registers[SREG_AX] = callImportedFunction(_registers[int1]._function, NULL, params);
-			}
-
-			// TODO: unfinished
-			funcArgumentCount = (uint)-1;
-			nextCallNeedsObject = false;
-			break;
-		case SCMD_PUSHREAL:
+			VM_NEXT;
+		VM_CASE(SCMD_PUSHREAL):
 			// farpush: push reg1 onto real stack
 			if (externalStack.size() >= MAX_FUNC_PARAMS)
 				error("external call stack overflow at line %d", _lineNumber);
 			externalStack.push(_registers[int1]);
-			break;
-		case SCMD_SUBREALSTACK:
+			VM_NEXT;
+		VM_CASE(SCMD_SUBREALSTACK):
 			// farsubsp
 			if (recoverFromCallAs) {
 				for (uint i = 0; i < (uint)int1; ++i)
@@ -1208,31 +1552,31 @@ void ccInstance::runCodeFrom(uint32 start) {
 				error("script tried to farsubsp %d parameters, but there were only %d", int1, externalStack.size());
 			for (uint i = 0; i < (uint32)int1; ++i)
 				externalStack.pop();
-			break;
-		case SCMD_CALLOBJ:
+			VM_NEXT;
+		VM_CASE(SCMD_CALLOBJ):
 			// $callobj: next call is member function of reg1
 			nextCallNeedsObject = true;
 			// set the OP register
 			// (we don't check for validity here because the next call might not be CALLEXT)
 			_registers[SREG_OP] = _registers[int1];
-			break;
-		case SCMD_SHIFTLEFT:
+			VM_NEXT;
+		VM_CASE(SCMD_SHIFTLEFT):
 			// reg1 = reg1 << reg2
 			_registers[int1]._signedValue <<= _registers[int2]._signedValue;
-			break;
-		case SCMD_SHIFTRIGHT:
+			VM_NEXT;
+		VM_CASE(SCMD_SHIFTRIGHT):
 			// reg1 = reg1 >> reg2
 			_registers[int1]._signedValue >>= _registers[int2]._signedValue;
-			break;
-		case SCMD_THISBASE:
+			VM_NEXT;
+		VM_CASE(SCMD_THISBASE):
 			// thisaddr: current relative address
 			currentBase.pop();
 			currentBase.push(int1);
-			break;
-		case SCMD_NEWARRAY:
+			VM_NEXT;
+		VM_CASE(SCMD_NEWARRAY):
 			// reg1 = new array of reg1 elements, each of size arg2 (arg3=managed type?)
 			{
-				bool managed = (code[_pc + 3]._data == 1);
+				bool managed = (ins->_args[2] == 1);
 				uint32 elemSize = int2;
 				assert(_registers[int1]._type == rvtInteger);
 				uint32 elemCount = _registers[int1]._value;
@@ -1242,50 +1586,50 @@ void ccInstance::runCodeFrom(uint32 start) {
 				_registers[int1] = tempObj;
 				tempObj->DecRef();
 			}
-			break;
-		case SCMD_FADD:
+			VM_NEXT;
+		VM_CASE(SCMD_FADD):
 			// reg1 += arg2 (float,int)
 			_registers[int1]._floatValue += int2;
-			break;
-		case SCMD_FSUB:
+			VM_NEXT;
+		VM_CASE(SCMD_FSUB):
 			// reg1 -= arg2 (float,int)
 			_registers[int1]._floatValue -= int2;
-			break;
-		case SCMD_FMULREG:
+			VM_NEXT;
+		VM_CASE(SCMD_FMULREG):
 			// reg1 *= reg2 (float)
 			_registers[int1]._floatValue *= _registers[int2]._floatValue;
-			break;
-		case SCMD_FDIVREG:
+			VM_NEXT;
+		VM_CASE(SCMD_FDIVREG):
 			// reg1 /= reg2 (float)
 			if (_registers[int2]._floatValue == 0.0)
 				error("script tried to divide by fp zero on line %d", _lineNumber);
 			_registers[int1]._floatValue /= _registers[int2]._floatValue;
-			break;
-		case SCMD_FADDREG:
+			VM_NEXT;
+		VM_CASE(SCMD_FADDREG):
 			// reg1 += reg2 (float)
 			_registers[int1]._floatValue += _registers[int2]._floatValue;
-			break;
-		case SCMD_FSUBREG:
+			VM_NEXT;
+		VM_CASE(SCMD_FSUBREG):
 			// reg1 -= reg2 (float)
 			_registers[int1]._floatValue -= _registers[int2]._floatValue;
-			break;
-		case SCMD_FGREATER:
+			VM_NEXT;
+		VM_CASE(SCMD_FGREATER):
 			// reg1 > reg2 (float)
 			_registers[int1] = (_registers[int1]._floatValue > _registers[int2]._floatValue) ? 1.0f : 0.0f;
-			break;
-		case SCMD_FLESSTHAN:
+			VM_NEXT;
+		VM_CASE(SCMD_FLESSTHAN):
 			// reg1 < reg2 (float)
 			_registers[int1] = (_registers[int1]._floatValue < _registers[int2]._floatValue) ? 1.0f : 0.0f;
-			break;
-		case SCMD_FGTE:
+			VM_NEXT;
+		VM_CASE(SCMD_FGTE):
 			// reg1 >= reg2 (float)
 			_registers[int1] = (_registers[int1]._floatValue >= _registers[int2]._floatValue) ? 1.0f : 0.0f;
-			break;
-		case SCMD_FLTE:
+			VM_NEXT;
+		VM_CASE(SCMD_FLTE):
 			// reg1 <= reg2 (float)
 			_registers[int1] = (_registers[int1]._floatValue <= _registers[int2]._floatValue) ? 1.0f : 0.0f;
-			break;
-		case SCMD_ZEROMEMORY:
+			VM_NEXT;
+		VM_CASE(SCMD_ZEROMEMORY):
 			// m[MAR]..m[MAR+(arg1-1)] = 0
 			tempVal = _registers[SREG_MAR];
 			switch (tempVal._type) {
@@ -1293,55 +1637,75 @@ void ccInstance::runCodeFrom(uint32 start) {
 				if (tempVal._value + (uint32)int1 >= _stack.size())
 					error("script tried to ZEROMEMORY out-of-bounds stack@%d-%d on line %d",
 						tempVal._value, int1, _lineNumber);
-				for (uint i = 0; i < (uint32)int1; ++i)
-					_stack[tempVal._value + i] = 0;
+				clearStack(tempVal._value, int1);
+				memset(&_stack[tempVal._value], 0, int1);
+				memset(&_stackTypes[tempVal._value], rvtInteger, int1);
+				break;
+			case rvtSystemObject:
+				if (!tempVal._object->isOfType(sotDynamicArray))
+					error("script tried to ZEROMEMORY a '%s' on line %d",
+						tempVal._object->getObjectTypeName(), _lineNumber);
+				((ScriptDynamicArray *)tempVal._object)->zeroBytes(tempVal._value, int1);
 				break;
 			default:
 				error("script tried to ZEROMEMORY using runtime value of type %d (value %d) on line %d",
 					tempVal._type, tempVal._value, _lineNumber);
 			}
-			break;
-		case SCMD_CREATESTRING:
+			VM_NEXT;
+		VM_CASE(SCMD_CREATESTRING):
 			// reg1 = new String(reg1)
 			tempStr1 = createStringFrom(_registers[int1]);
 			_registers[int1] = new ScriptMutableString(tempStr1->getString());
 			_registers[int1]._object->DecRef();
 			tempStr1->DecRef();
-			break;
-		case SCMD_STRINGSEQUAL:
+			VM_NEXT;
+		VM_CASE(SCMD_STRINGSEQUAL):
 			// (char*)reg1 == (char*)reg2   reg1=1 if true, =0 if not
 			tempStr1 = createStringFrom(_registers[int1]);
 			tempStr2 = createStringFrom(_registers[int2]);
 			_registers[int1] = tempStr1->getString().equals(tempStr2->getString()) ? 1 : 0;
 			tempStr1->DecRef();
 			tempStr2->DecRef();
-			break;
-		case SCMD_STRINGSNOTEQ:
+			VM_NEXT;
+		VM_CASE(SCMD_STRINGSNOTEQ):
 			// (char*)reg1 != (char*)reg2
 			tempStr1 = createStringFrom(_registers[int1]);
 			tempStr2 = createStringFrom(_registers[int2]);
 			_registers[int1] = tempStr1->getString().equals(tempStr2->getString()) ? 0 : 1;
 			tempStr1->DecRef();
 			tempStr2->DecRef();
-			break;
-		case SCMD_LOOPCHECKOFF:
+			VM_NEXT;
+		VM_CASE(SCMD_LOOPCHECKOFF):
 			// no loop checking for this function
 			if (loopIterationCheckDisabledCount == 0)
 				loopIterationCheckDisabledCount++;
-			break;
+			VM_NEXT;
+#ifdef AGS_VM_THREADED_DISPATCH
+		vm_invalid:
+#else
 		default:
-			error("runCodeFrom(): invalid instruction %d", instruction);
+#endif
+			// only the end-of-code marker can get here
+			error("runCodeFrom(): ran off the end of the code (at %d) on line %d", ins->_offset, _lineNumber);
 		}
 
-		if (_registers[SREG_SP]._type != rvtStackPointer || _registers[SREG_SP]._value < 4 || _registers[SREG_SP]._value >= _stack.size())
-			error("runCodeFrom(): SP got clobbered (now type %d, value %d) on line %d",
-				_registers[SREG_SP]._type, _registers[SREG_SP]._value, _lineNumber);
-
-		// increment to next instruction, skipping any arguments
-		_pc += (1 + neededArgs);
+#ifndef AGS_VM_THREADED_DISPATCH
+		VM_ADVANCE();
 	}
+#endif
 }
 
+#ifdef AGS_VM_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
+#undef VM_FETCH
+#undef VM_ADVANCE
+#undef VM_CASE
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_RESTART
+
 const uint kOldScriptStringLength = 200;
 
 class ScriptStackString : public ScriptString {
@@ -1355,11 +1719,11 @@ public:
 		// FIXME: sanity-check types
 		Common::String text;
 		for (uint i = 0; i < kOldScriptStringLength; ++i) {
-			if (_instance->_stack[_offset + i]._value == 0)
+			if (_instance->_stack[_offset + i] == 0)
 				break;
 			if (i == kOldScriptStringLength - 1)
 				error("ScriptStackString: string isn't null-terminated");
-			text += (char)_instance->_stack[_offset + i]._value;
+			text += (char)_instance->_stack[_offset + i];
 		}
 		return text;
 	}
@@ -1370,9 +1734,9 @@ public:
 			error("ScriptStackString: new string is too large (%d)", text.size());
 
 		for (uint i = 0; i < text.size(); ++i) {
-			_instance->_stack[_offset + i] = (uint)text[i];
+			_instance->writeStack(_offset + i, (uint32)(byte)text[i], 1);
 		}
-		_instance->_stack[_offset + text.size()] = 0;
+		_instance->writeStack(_offset + text.size(), RuntimeValue(), 1);
 	}
 
 protected:
@@ -1418,8 +1782,7 @@ ScriptString *ccInstance::createStringFrom(RuntimeValue &value, bool allowFailur
 		return new ScriptStackString(this, value._value);
 	else if (value._type == rvtScriptData) {
 		ccScript *script = value._instance->_script;
-		uint32 *fixup = Common::find(script->_globalFixups.begin(), script->_globalFixups.end(), value._value);
-		if (fixup != script->_globalFixups.end())
+		if (script->isGlobalFixup(value._value))
 			error("createStringFrom called with (fixup) pointer to string");
 		return new ScriptDataString(value._instance, value._value);
 	} else if (value._type == rvtSystemObject && value._object->isOfType(sotString)) {
@@ -1444,90 +1807,82 @@ ScriptString *ccInstance::createStringFrom(RuntimeValue &value, bool allowFailur
 	error("createStringFrom failed to create a string from value of type %d", value._type);
 }
 
-RuntimeValue ccInstance::callImportedFunction(const ScriptSystemFunctionInfo *function,
+RuntimeValue ccInstance::callImportedFunction(const ScriptSystemFunction *function,
 	ScriptObject *object, Common::Array<RuntimeValue> &params) {
+	const ScriptSystemFunctionInfo *info = function->info;
+
+	// check the (pre-compiled) signature
+	if (params.size() < function->argCount)
+		error("not enough parameters (%d) to '%s'", params.size(), info->name);
 
-	// check the signature
-	uint pos = 0;
-	while (function->signature[pos] != '\0' && function->signature[pos] != '.') {
-		if (pos == params.size())
-			error("not enough parameters (%d) to '%s'", params.size(), function->name);
-
-		char sigEntry = function->signature[pos];
-		switch (sigEntry) {
-		case 'i':
-		case 'c':
-			// integer
-			if (params[pos]._type != rvtInteger)
+	uint pos;
+	for (pos = 0; pos < function->argCount; ++pos) {
+		RuntimeValue &param = params[pos];
+
+		switch (function->argTypes[pos]) {
+		case sstInteger:
+			if (param._type != rvtInteger)
 				error("expected integer for param %d of '%s', got type %d",
-					pos + 1, function->name, params[pos]._type);
+					pos + 1, info->name, param._type);
 			break;
-		case 'f':
-			// float
-			if (params[pos]._type == rvtInteger) {
+		case sstFloat:
+			if (param._type == rvtInteger) {
 				// FIXME: This is horrible.
-				params[pos]._type = rvtFloat;
+				param._type = rvtFloat;
 			}
-			if (params[pos]._type != rvtFloat)
+			if (param._type != rvtFloat)
 				error("expected float for param %d of '%s', got type %d",
-					pos + 1, function->name, params[pos]._type);
+					pos + 1, info->name, param._type);
 			break;
-		case 'p':
-			// object OR null
-			if (params[pos]._type == rvtInteger && params[pos]._value == 0)
+		case sstObjectOrNull:
+			if (param._type == rvtInteger && param._value == 0)
 				break;
 			// (fallthrough)
-		case 'o':
-			// object
-			if (params[pos]._type != rvtSystemObject)
+		case sstObject:
+			if (param._type != rvtSystemObject)
 				error("expected object for param %d of '%s', got type %d",
-					pos + 1, function->name, params[pos]._type);
+					pos + 1, info->name, param._type);
 			uint32 offset;
-			offset = params[pos]._value;
-			params[pos] = params[pos]._object->getObjectAt(offset);
-			params[pos]._value = offset;
+			offset = param._value;
+			param = param._object->getObjectAt(offset);
+			param._value = offset;
 			break;
-		case 't':
-			// string OR null
-			if (params[pos]._type == rvtInteger && params[pos]._value == 0)
+		case sstStringOrNull:
+			if (param._type == rvtInteger && param._value == 0)
 				break;
 			// (fallthrough)
-		case 's':
-			// string
-			if (params[pos]._type == rvtStackPointer || params[pos]._type == rvtScriptData) {
-				params[pos] = createStringFrom(params[pos]);
-				params[pos]._object->DecRef();
+		case sstString:
+			if (param._type == rvtStackPointer || param._type == rvtScriptData) {
+				param = createStringFrom(param);
+				param._object->DecRef();
 				break;
 			}
-			if (params[pos]._type != rvtSystemObject || !params[pos]._object->isOfType(sotString)) {
-				ScriptString *str = createStringFrom(params[pos]);
+			if (param._type != rvtSystemObject || !param._object->isOfType(sotString)) {
+				ScriptString *str = createStringFrom(param);
 				if (!str)
 					error("expected string for param %d of '%s', got type %d",
-						pos + 1, function->name, params[pos]._type);
-				params[pos] = str;
+						pos + 1, info->name, param._type);
+				param = str;
 				str->DecRef();
 				break;
 			}
-			if (params[pos]._value != 0)
+			if (param._value != 0)
 				error("unexpected offset %d when creating string object for param %d of '%s'",
-					params[pos]._value, pos + 1, function->name);
+					param._value, pos + 1, info->name);
 			break;
-		default:
-			error("unknown entry in signature '%s' for '%s'", function->signature, function->name);
 		}
-		++pos;
 	}
 
-	if (function->objectType && !object)
-		error("expected '%s' to be called on an object", function->name);
+	if (info->objectType && !object)
+		error("expected '%s' to be called on an object", info->name);
 
 	// if this is a member function, make sure it's being called on an object of the right type
 	if (object) {
-		if (!object->isOfType(function->objectType))
-			error("'%s' was passed an object with the wrong type '%s'", function->name, object->getObjectTypeName());
+		if (!object->isOfType(info->objectType))
+			error("'%s' was passed an object with the wrong type '%s'", info->name, object->getObjectTypeName());
 	}
 
-	if (function->signature[pos] == '.') {
+	if (function->isVarArgs) {
 		// variable argument function
 		while (pos < params.size()) {
 			if (params[pos]._type != rvtInteger && params[pos]._type != rvtFloat) {
@@ -1544,9 +1899,61 @@ RuntimeValue ccInstance::callImportedFunction(const ScriptSystemFunctionInfo *fu
 			++pos;
 		}
 	} else if (pos < params.size())
-		error("too many parameters (%d) to '%s'", params.size(), function->name);
+		error("too many parameters (%d) to '%s'", params.size(), info->name);
+
+	return info->function(_vm, object, params);
+}
+
+static inline bool isStackObjectType(byte type) {
+	return type == rvtScriptData || type == rvtScriptFunction || type == rvtSystemFunction || type == rvtSystemObject;
+}
+
+RuntimeValue ccInstance::readStack(uint32 offset) {
+	byte type = _stackTypes[offset];
+	if (isStackObjectType(type))
+		return _stackObjects[offset];
+
+	RuntimeValue value;
+	value._type = (RuntimeValueType)type;
+	value._value = READ_LE_UINT32(&_stack[offset]);
+	return value;
+}
+
+void ccInstance::writeStack(uint32 offset, const RuntimeValue &value, uint size) {
+	clearStack(offset, size);
+
+	_stackTypes[offset] = value._type;
+	switch (size) {
+	case 1:
+		_stack[offset] = (byte)value._value;
+		break;
+	case 2:
+		WRITE_LE_UINT16(&_stack[offset], value._value);
+		break;
+	default:
+		WRITE_LE_UINT32(&_stack[offset], value._value);
+		break;
+	}
+	if (isStackObjectType(value._type))
+		_stackObjects[offset] = value;
+}
+
+void ccInstance::clearStack(uint32 offset, uint size) {
+	for (uint i = offset; i < offset + size; ++i) {
+		if (isStackObjectType(_stackTypes[i]))
+			_stackObjects.erase(i);
+		_stackTypes[i] = rvtInvalid;
+	}
+}
 
-	return function->function(_vm, object, params);
+bool ccInstance::isStackInteger(uint32 offset) {
+	// is this byte part of an integer value?
+	for (uint i = 0; i < 4 && i <= offset; ++i) {
+		byte type = _stackTypes[offset - i];
+		if (type != rvtInvalid)
+			return (type == rvtInteger);
+	}
+	return false;
 }
 
 void ccInstance::pushValue(const RuntimeValue &value) {
@@ -1557,10 +1964,7 @@ void ccInstance::pushValue(const RuntimeValue &value) {
 	if (stackValue + 4 > _stack.size())
 		error("script caused VM stack overflow");
 
-	_stack[stackValue] = value;
-	_stack[stackValue + 1].invalidate();
-	_stack[stackValue + 2].invalidate();
-	_stack[stackValue + 3].invalidate();
+	writeStack(stackValue, value);
 
 	_registers[SREG_SP]._value += 4;
 }
@@ -1573,10 +1977,10 @@ RuntimeValue ccInstance::popValue() {
 	uint32 stackValue = _registers[SREG_SP]._value;
 	if (stackValue + 4 > _stack.size())
 		error("script caused VM stack underflow(?!) on line %d", _lineNumber);
-	if (_stack[stackValue]._type == rvtInvalid)
+	if (_stackTypes[stackValue] == rvtInvalid)
 		error("script tried to pop invalid value from stack on line %d", _lineNumber);
 
-	return _stack[stackValue];
+	return readStack(stackValue);
 }
 
 uint32 ccInstance::popIntValue() {
@@ -1593,14 +1997,12 @@ ScriptObject *ccInstance::getObjectFrom(const RuntimeValue &value) {
 	switch (value._type) {
 	case rvtScriptData:
 		ccScript *instScript;
-		uint32 *fixup;
 		instScript = value._instance->_script;
-		if (value._instance->_globalObjects->contains(value._value))
+		if (value._instance->hasGlobalObject(value._value))
 			return getObjectFrom((*value._instance->_globalObjects)[value._value]);
 
 		// no object, might still have a null pointer?
-		fixup = Common::find(instScript->_globalFixups.begin(), instScript->_globalFixups.end(), value._value);
-		if (fixup != instScript->_globalFixups.end())
+		if (instScript->isGlobalFixup(value._value))
 			error("getObjectFrom got fixup for data@%d on line %d", value._value, _lineNumber);
 		// FIXME: bounds check
 		uint32 val;
@@ -1617,9 +2019,9 @@ ScriptObject *ccInstance::getObjectFrom(const RuntimeValue &value) {
 		if (value._value + 4 > _stack.size())
 			error("script tried to get object from beyond the end of the stack (value %d) on line %d",
 				value._value, _lineNumber);
-		if (_stack[value._value]._type == rvtSystemObject)
-			result = _stack[value._value];
-		else if (_stack[value._value]._type == rvtInteger && _stack[value._value]._value == 0)
+		if (_stackTypes[value._value] == rvtSystemObject)
+			result = _stackObjects[value._value];
+		else if (_stackTypes[value._value] == rvtInteger && READ_LE_UINT32(&_stack[value._value]) == 0)
 			return NULL;
 		else
 			error("script tried to get object using stack (offset %d) on line %d",
@@ -1638,26 +2040,43 @@ ScriptObject *ccInstance::getObjectFrom(const RuntimeValue &value) {
 	return obj;
 }
 
+void ccInstance::setGlobalObject(uint32 offset, const RuntimeValue &value) {
+	if ((offset >> 3) >= _globalObjectMap->size())
+		error("script tried to store object beyond the end of global data (offset %d) on line %d",
+			offset, _lineNumber);
+	(*_globalObjects)[offset] = value;
+	(*_globalObjectMap)[offset >> 3] |= (1 << (offset & 7));
+}
+
+void ccInstance::removeGlobalObject(uint32 offset) {
+	if (!hasGlobalObject(offset))
+		return;
+	_globalObjects->erase(offset);
+	(*_globalObjectMap)[offset >> 3] &= ~(1 << (offset & 7));
+}
+
 void ccInstance::writePointer(const RuntimeValue &value, ScriptObject *object) {
 	ccScript *instScript;
-	uint32 *fixup;
 	switch (value._type) {
 	case rvtScriptData:
 		// FIXME: bounds checks
 		instScript = value._instance->_script;
-		fixup = Common::find(instScript->_globalFixups.begin(), instScript->_globalFixups.end(), value._value);
 		// FIXME: *wrong*, this should be a pointer?
 		// FIXME	argVal[v]._value = (*inst->_globalData)[argValue];
-		if (fixup != instScript->_globalFixups.end())
+		if (instScript->isGlobalFixup(value._value))
 			error("writePointer fixup fail");
 		// writing an object to script global data
 		WRITE_LE_UINT32(&(*value._instance->_globalData)[value._value], 0);
 		if (object)
-			(*value._instance->_globalObjects)[value._value] = object;
+			value._instance->setGlobalObject(value._value, object);
 		else
-			value._instance->_globalObjects->erase(value._value);
+			value._instance->removeGlobalObject(value._value);
 		break;
 	case rvtSystemObject:
+		if (value._object->isOfType(sotDynamicArray) && ((ScriptDynamicArray *)value._object)->isManaged()) {
+			((ScriptDynamicArray *)value._object)->setObject(value._value, object);
+			break;
+		}
 		// FIXME: !!!
 		error("script tried to writePointer to system object (value %d) on line %d",
 			value._value, _lineNumber);
@@ -1667,12 +2086,9 @@ void ccInstance::writePointer(const RuntimeValue &value, ScriptObject *object) {
 			error("script tried to writePointer to out-of-bounds stack@%d on line %d",
 				value._value, _lineNumber);
 		if (object)
-			_stack[value._value] = object;
+			writeStack(value._value, object);
 		else
-			_stack[value._value] = 0;
-		_stack[value._value + 1].invalidate();
-		_stack[value._value + 2].invalidate();
-		_stack[value._value + 3].invalidate();
+			writeStack(value._value, RuntimeValue());
 		break;
 	default:
 		error("script tried to writePointer to runtime value of type %d (value %d) on line %d",
@@ -48,10 +48,48 @@ struct ScriptCodeEntry {
 	byte _fixupType; // global data/string area/ etc
 };
 
+// problems found while decoding an instruction, reported by the verifier
+enum ScriptInstructionProblem {
+	sipNone = 0,
+	sipInvalidOpcode,
+	sipMissingArgs,
+	sipUnexpectedFixup,
+	sipInvalidRegister,
+	sipEndOfCode
+};
+
+#define SCRIPT_NO_INSTRUCTION 0xffffffff
+
+#define MAX_FUNC_PARAMS 20 // maximum size of externalStack
+
+// An instruction from the script code, decoded once at load time so that
+// the interpreter doesn't need to look at the raw code or fixups again.
+struct ScriptInstruction {
+	// offset of the opcode in the raw code
+	uint32 _offset;
+	byte _opcode;
+	byte _numArgs;
+	byte _argFixupTypes[2];
+	uint32 _args[3];
+	// index of the instruction to continue at if a jump is taken
+	uint32 _jumpTarget;
+	byte _problem;
+	byte _problemArg;
+};
+
 struct ScriptExport {
 	Common::String _name;
 	ScriptImportType _type;
 	uint32 _address;
+	// from the mangled name, or -1 if unknown
+	int _paramCount;
+};
+
+// events which are run every game loop, so are looked up at load time
+enum ScriptEvent {
+	kScriptEventRepeatedlyExecute = 0,
+	kScriptEventRepeatedlyExecuteAlways,
+	kScriptEventCount
 };
 
 // 'sections' allow the interpreter to find out which bit
@@ -81,7 +119,7 @@ enum RuntimeValueType {
 class AGSEngine;
 class ccInstance;
 struct RuntimeValue;
-struct ScriptSystemFunctionInfo;
+struct ScriptSystemFunction;
 
 struct RuntimeValue {
 	RuntimeValue() : _type(rvtInteger), _value(0) { }
@@ -121,7 +159,7 @@ struct RuntimeValue {
 	union {
 		ccInstance *_instance;
 		ScriptObject *_object;
-		const ScriptSystemFunctionInfo *_function;
+		const ScriptSystemFunction *_function;
 	};
 
 	RuntimeValue &operator=(int32 intValue) {
@@ -172,15 +210,34 @@ struct RuntimeValue {
 
 // the data for a script
 struct ccScript {
+	~ccScript();
+
 	void readFrom(Common::SeekableReadStream *dta);
+	void decodeInstructions();
+	void verifyInstructions();
+
+	int findExport(const Common::String &name) const;
+
+	bool isGlobalFixup(uint32 offset) const {
+		return (offset >> 3) < _globalFixups.size() && (_globalFixups[offset >> 3] & (1 << (offset & 7)));
+	}
 
 	Common::Array<byte> _globalData;
-	Common::Array<uint32> _globalFixups;
+	// bitmap of the global data offsets which have fixups
+	Common::Array<byte> _globalFixups;
 
 	Common::Array<ScriptCodeEntry> _code;
+	Common::Array<ScriptInstruction> _instructions;
+	// maps code offsets to indexes into _instructions
+	Common::Array<uint32> _instructionIndex;
 	Common::Array<byte> _strings;
+	// shared string objects for the string fixups, by offset into _strings
+	Common::HashMap<uint32, ScriptConstString *> _stringObjects;
 	Common::Array<Common::String> _imports;
 	Common::Array<ScriptExport> _exports;
+	// indexes into _exports, by both mangled and unmangled name
+	Common::HashMap<Common::String, uint32, Common::CaseSensitiveString_Hash, Common::CaseSensitiveString_EqualTo> _exportIndex;
+	int _eventExports[kScriptEventCount];
 	uint32 _instances;
 	Common::Array<ScriptSection> _sections;
 };
@@ -192,7 +249,7 @@ struct ScriptImport {
 
 	// function pointer (system)
 	union {
-		const ScriptSystemFunctionInfo *_function;
+		const ScriptSystemFunction *_function;
 		class ScriptObject *_object;
 	};
 
@@ -224,15 +281,22 @@ public:
 
 	bool isRunning() { return (_pc != 0); }
 	bool exportsSymbol(const Common::String &name);
+	int findExport(const Common::String &name) const { return _script->findExport(name); }
+	int getEventExport(ScriptEvent event) const { return _script->_eventExports[event]; }
+	const Common::String &getExportName(uint exportId) const { return _script->_exports[exportId]._name; }
 	void call(const Common::String &name, const Common::Array<RuntimeValue> &params);
+	void call(uint exportId, const Common::Array<RuntimeValue> &params);
 	ScriptState *saveState();
 
 	uint32 getReturnValue();
 
 protected:
 	void runCodeFrom(uint32 start);
+	void dumpInstruction(ccInstance *inst, const ScriptInstruction &ins);
+	uint32 getInstructionAt(ccInstance *inst, uint32 offset);
+	RuntimeValue resolveArgument(ccInstance *inst, const ScriptInstruction &ins, uint arg);
 	ScriptString *createStringFrom(RuntimeValue &value, bool allowFailure = false);
-	RuntimeValue callImportedFunction(const ScriptSystemFunctionInfo *function, ScriptObject *object,
+	RuntimeValue callImportedFunction(const ScriptSystemFunction *function, ScriptObject *object,
 		Common::Array<RuntimeValue> &params);
 
 	AGSEngine *_vm;
@@ -241,17 +305,40 @@ protected:
 
 	Common::Array<byte> *_globalData;
 	Common::HashMap<uint32, RuntimeValue> *_globalObjects;
+	// bitmap of the global data offsets which are in _globalObjects
+	Common::Array<byte> *_globalObjectMap;
+
+	bool hasGlobalObject(uint32 offset) const {
+		return (offset >> 3) < _globalObjectMap->size() && ((*_globalObjectMap)[offset >> 3] & (1 << (offset & 7)));
+	}
+	void setGlobalObject(uint32 offset, const RuntimeValue &value);
+	void removeGlobalObject(uint32 offset);
 
 	uint32 _pc;
 	RuntimeValue _returnValue;
 	uint32 _lineNumber;
+	// number of instructions executed (for measuring the interpreter)
+	uint32 _instructionCount;
 	Common::Array<RuntimeValue> _registers;
 	Common::Array<CallStackEntry> _callStack;
-	Common::Array<RuntimeValue> _stack;
+	// the stack is raw little-endian data; the type of the value starting at
+	// each offset is kept alongside, and values which refer to an instance or
+	// object are also kept (with their reference) in _stackObjects
+	Common::Array<byte> _stack;
+	Common::Array<byte> _stackTypes;
+	Common::HashMap<uint32, RuntimeValue> _stackObjects;
 	Common::Array<ScriptImport> _resolvedImports;
+	// parameter lists for system function calls, reused at each nesting depth
+	Common::Array<Common::Array<RuntimeValue> *> _paramBuffers;
+	uint _paramDepth;
 	// might point to another instance if in far call
 	ccInstance *_runningInst;
 
+	RuntimeValue readStack(uint32 offset);
+	void writeStack(uint32 offset, const RuntimeValue &value, uint size = 4);
+	void clearStack(uint32 offset, uint size);
+	bool isStackInteger(uint32 offset);
+
 	void pushValue(const RuntimeValue &value);
 	RuntimeValue popValue();
 	uint32 popIntValue();
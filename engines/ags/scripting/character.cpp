@@ -1358,18 +1358,25 @@ RuntimeValue Script_Character_Think(AGSEngine *vm, Character *self, const Common
 // Tints the character to the specified colour.
 RuntimeValue Script_Character_Tint(AGSEngine *vm, Character *self, const Common::Array<RuntimeValue> &params) {
 	int red = params[0]._signedValue;
-	UNUSED(red);
 	int green = params[1]._signedValue;
-	UNUSED(green);
 	int blue = params[2]._signedValue;
-	UNUSED(blue);
 	int saturation = params[3]._signedValue;
-	UNUSED(saturation);
 	int luminance = params[4]._signedValue;
-	UNUSED(luminance);
 
-	// FIXME
-	error("Character::Tint unimplemented");
+	if (red < 0 || red > 255 || green < 0 || green > 255 || blue < 0 || blue > 255)
+		error("Character::Tint: invalid RGB values (%d, %d, %d)", red, green, blue);
+	if (saturation < 0 || saturation > 100 || luminance < 0 || luminance > 100)
+		error("Character::Tint: invalid saturation/luminance (%d, %d)", saturation, luminance);
+
+	debugC(kDebugLevelGame, "character '%s' (id %d) now tinted to (%d, %d, %d)",
+		self->_scriptName.c_str(), self->_indexId, red, green, blue);
+
+	self->_tintR = red;
+	self->_tintG = green;
+	self->_tintB = blue;
+	self->_tintLevel = saturation;
+	self->_tintLight = (luminance * 25) / 10;
+	self->_flags |= CHF_HASTINT;
 
 	return RuntimeValue();
 }
@@ -606,8 +606,7 @@ RuntimeValue Script_Object_Move(AGSEngine *vm, RoomObject *self, const Common::A
 // Object: import function RemoveTint()
 // Removes a specific object tint, and returns the object to using the ambient room tint.
 RuntimeValue Script_Object_RemoveTint(AGSEngine *vm, RoomObject *self, const Common::Array<RuntimeValue> &params) {
-	// FIXME
-	error("Object::RemoveTint unimplemented");
+	self->_flags &= ~OBJF_HASTINT;
 
 	return RuntimeValue();
 }
@@ -672,18 +671,22 @@ RuntimeValue Script_Object_StopMoving(AGSEngine *vm, RoomObject *self, const Com
 // Tints the object to the specified colour.
 RuntimeValue Script_Object_Tint(AGSEngine *vm, RoomObject *self, const Common::Array<RuntimeValue> &params) {
 	int red = params[0]._signedValue;
-	UNUSED(red);
 	int green = params[1]._signedValue;
-	UNUSED(green);
 	int blue = params[2]._signedValue;
-	UNUSED(blue);
 	int saturation = params[3]._signedValue;
-	UNUSED(saturation);
 	int luminance = params[4]._signedValue;
-	UNUSED(luminance);
 
-	// FIXME
-	error("Object::Tint unimplemented");
+	if (red < 0 || red > 255 || green < 0 || green > 255 || blue < 0 || blue > 255)
+		error("Object::Tint: invalid RGB values (%d, %d, %d)", red, green, blue);
+	if (saturation < 0 || saturation > 100 || luminance < 0 || luminance > 100)
+		error("Object::Tint: invalid saturation/luminance (%d, %d)", saturation, luminance);
+
+	self->_tintRed = red;
+	self->_tintGreen = green;
+	self->_tintBlue = blue;
+	self->_tintLevel = saturation;
+	self->_tintLight = (luminance * 25) / 10;
+	self->_flags |= OBJF_HASTINT;
 
 	return RuntimeValue();
 }
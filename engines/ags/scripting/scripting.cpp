@@ -33,6 +33,11 @@ RuntimeValue Script_UnimplementedStub(AGSEngine *vm, ScriptObject *self, const C
 	error("call to unimplemented system scripting function");
 }
 
+GlobalScriptState::~GlobalScriptState() {
+	for (uint i = 0; i < _systemFunctions.size(); ++i)
+		delete _systemFunctions[i];
+}
+
 void GlobalScriptState::addImport(const Common::String &name, const ScriptImport &import, bool forceReplace) {
 	// Original ignores attempts by scripts to import symbols with empty strings,
 	// so there's no point adding any such symbols to the global list.
@@ -76,10 +81,51 @@ void GlobalScriptState::removeImport(const Common::String &name) {
 }
 
 void GlobalScriptState::addSystemFunctionImport(const ScriptSystemFunctionInfo *function) {
+	ScriptSystemFunction *compiled = new ScriptSystemFunction;
+	compiled->info = function;
+	compiled->argCount = 0;
+	compiled->isVarArgs = false;
+
+	for (const char *sig = function->signature; *sig; ++sig) {
+		if (*sig == '.') {
+			compiled->isVarArgs = true;
+			break;
+		}
+		if (compiled->argCount == MAX_FUNC_PARAMS)
+			error("too many entries in signature '%s' for '%s'", function->signature, function->name);
+
+		byte type;
+		switch (*sig) {
+		case 'i':
+		case 'c':
+			type = sstInteger;
+			break;
+		case 'f':
+			type = sstFloat;
+			break;
+		case 'o':
+			type = sstObject;
+			break;
+		case 'p':
+			type = sstObjectOrNull;
+			break;
+		case 's':
+			type = sstString;
+			break;
+		case 't':
+			type = sstStringOrNull;
+			break;
+		default:
+			error("unknown entry in signature '%s' for '%s'", function->signature, function->name);
+		}
+		compiled->argTypes[compiled->argCount++] = type;
+	}
+	_systemFunctions.push_back(compiled);
+
 	ScriptImport import;
 
 	import._type = sitSystemFunction;
-	import._function = function;
+	import._function = compiled;
 
 	addImport(function->name, import, true);
 }
@@ -58,8 +58,29 @@ struct ScriptSystemFunctionInfo {
 	ScriptObjectType objectType;
 };
 
+// the parameter types in a signature
+enum ScriptSignatureType {
+	sstInteger,		// 'i'/'c'
+	sstFloat,		// 'f'
+	sstObject,		// 'o'
+	sstObjectOrNull,	// 'p'
+	sstString,		// 's'
+	sstStringOrNull		// 't'
+};
+
+// a system function, with the signature compiled when it was registered
+struct ScriptSystemFunction {
+	const ScriptSystemFunctionInfo *info;
+	byte argTypes[MAX_FUNC_PARAMS];
+	uint argCount;
+	// signature ends with '.'
+	bool isVarArgs;
+};
+
 class GlobalScriptState {
 public:
+	~GlobalScriptState();
+
 	Common::HashMap<Common::String, ScriptImport, Common::CaseSensitiveString_Hash, Common::CaseSensitiveString_EqualTo> _imports;
 
 	void addImport(const Common::String &name, const ScriptImport &import, bool forceReplace = false);
@@ -67,6 +88,9 @@ public:
 	void addSystemFunctionImport(const ScriptSystemFunctionInfo *function);
 	void addSystemObjectImport(const Common::String &name, ScriptObject *object);
 	void addSystemFunctionImportList(const ScriptSystemFunctionInfo *list, uint32 count);
+
+protected:
+	Common::Array<ScriptSystemFunction *> _systemFunctions;
 };
 
 } // End of namespace AGS
@@ -49,7 +49,7 @@ struct Particle {
 struct View {
 	uint viewId, loopId;
 	bool isDefault;
-	Graphics::Surface *surface;
+	Sprite *sprite;
 };
 
 inline float signum(float x) { return (x > 0) ? 1 : -1; }
@@ -76,13 +76,15 @@ public:
 			_views[i].isDefault = true;
 			_views[i].viewId = (uint)-1;
 			_views[i].loopId = (uint)-1;
-			_views[i].surface = NULL;
+			_views[i].sprite = NULL;
 		}
 
 		setAmount(0);
 	}
 
 	~Weather() {
+		for (uint i = 0; i < _views.size(); ++i)
+			setViewSprite(_views[i], NULL);
 	}
 
 	void update(bool withDrift = false) {
@@ -129,7 +131,7 @@ public:
 			} else if (p.y > 0 && p.alpha > 0) {
 				// draw a sprite for this flake
 				// TODO: icky, also almost certainly wrong
-				_vm->_graphics->internalDraw(_views[p.type].surface, Common::Point(p.x, p.y), p.alpha);
+				_vm->_graphics->internalDraw(_views[p.type].sprite->_surface, Common::Point(p.x, p.y), p.alpha);
 			}
 		}
 	}
@@ -212,12 +214,17 @@ public:
 		initParticles();
 	}
 
+	// views keep their sprite acquired, so it can't be evicted
+	void setViewSprite(View &view, Sprite *sprite) {
+		if (view.sprite)
+			_vm->getSprites()->releaseSprite(view.sprite);
+		view.sprite = sprite;
+	}
+
 	void setView(uint type, uint view, uint loop) {
 		ViewFrame *frame = _vm->getViewFrame(view - 1, loop, 0);
-		Sprite *sprite = _vm->getSprites()->getSprite(frame->_pic);
-		// TODO: don't just discard the sprite?
 
-		_views[type].surface = sprite->_surface;
+		setViewSprite(_views[type], _vm->getSprites()->acquireSprite(frame->_pic));
 		_views[type].isDefault = false;
 		_views[type].viewId = view;
 		_views[type].loopId = loop;
@@ -228,8 +235,6 @@ public:
 
 	void setDefaultView(uint view, uint loop) {
 		ViewFrame *frame = _vm->getViewFrame(view - 1, loop, 0);
-		Sprite *sprite = _vm->getSprites()->getSprite(frame->_pic);
-		// TODO: don't just discard the sprite?
 
 		for (uint i = 0; i < _views.size(); ++i) {
 			if (!_views[i].isDefault)
@@ -237,7 +242,7 @@ public:
 
 			_views[i].viewId = view;
 			_views[i].loopId = loop;
-			_views[i].surface = sprite->_surface;
+			setViewSprite(_views[i], _vm->getSprites()->acquireSprite(frame->_pic));
 		}
 
 		_viewsInitialized = true;
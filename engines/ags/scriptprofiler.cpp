@@ -0,0 +1,255 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "common/algorithm.h"
+#include "common/file.h"
+#include "common/system.h"
+
+#include "engines/ags/scriptprofiler.h"
+#include "engines/ags/script.h"
+#include "engines/ags/scripting/scripting.h"
+
+namespace AGS {
+
+ScriptProfiler::ScriptProfiler() : _lastTime(0), _lastInstructions(0) {
+}
+
+ScriptProfiler::~ScriptProfiler() {
+	for (Common::HashMap<const ccScript *, ScriptCache *, ScriptProfilePointerHash>::iterator i = _scriptCaches.begin();
+		i != _scriptCaches.end(); ++i)
+		delete i->_value;
+}
+
+void ScriptProfiler::enterFunction(ccScript *script, uint32 address, uint32 instructionCount) {
+	update(instructionCount);
+
+	ScriptCache *cache = getCache(script);
+	ScriptProfileCounters *&function = cache->_functions[address];
+	if (!function) {
+		Common::String name = getFunctionName(script, address);
+		function = &_functions[name];
+		function->_name = name;
+	}
+
+	pushFrame(script, cache, function);
+}
+
+void ScriptProfiler::leaveFunction(uint32 instructionCount) {
+	update(instructionCount);
+
+	if (_frames.empty() || !_frames.back()._script)
+		error("ScriptProfiler: left a script function which wasn't running");
+	popFrame();
+}
+
+void ScriptProfiler::enterSystemFunction(const ScriptSystemFunctionInfo *info, uint32 instructionCount) {
+	update(instructionCount);
+
+	ScriptProfileCounters *&function = _systemFunctionCache[info];
+	if (!function) {
+		function = &_systemFunctions[info->name];
+		function->_name = info->name;
+	}
+
+	pushFrame(NULL, NULL, function);
+}
+
+void ScriptProfiler::leaveSystemFunction(uint32 instructionCount) {
+	update(instructionCount);
+
+	if (_frames.empty() || _frames.back()._script)
+		error("ScriptProfiler: left a system function which wasn't running");
+	popFrame();
+}
+
+void ScriptProfiler::setLine(uint32 offset, uint32 line, uint32 instructionCount) {
+	update(instructionCount);
+
+	if (_frames.empty() || !_frames.back()._script)
+		return;
+
+	Frame &frame = _frames.back();
+	ScriptProfileCounters *&counters = frame._cache->_lines[offset];
+	if (!counters) {
+		Common::String name = Common::String::format("%s:%d", getSectionName(frame._script, offset).c_str(), line);
+		counters = &_lines[name];
+		counters->_name = name;
+	}
+	counters->_calls++;
+	frame._line = counters;
+}
+
+void ScriptProfiler::forgetScript(ccScript *script) {
+	if (!_scriptCaches.contains(script))
+		return;
+
+	delete _scriptCaches[script];
+	_scriptCaches.erase(script);
+}
+
+void ScriptProfiler::update(uint32 instructionCount) {
+	uint32 now = g_system->getMillis();
+
+	if (!_frames.empty()) {
+		Frame &frame = _frames.back();
+
+		// instructions are only counted for script code
+		if (frame._script) {
+			uint32 instructions = instructionCount - _lastInstructions;
+			frame._function->_instructions += instructions;
+			if (frame._line)
+				frame._line->_instructions += instructions;
+		}
+
+		uint32 time = now - _lastTime;
+		if (time) {
+			frame._function->_selfTime += time;
+			if (frame._line)
+				frame._line->_selfTime += time;
+			_stacks[frame._stack] += time;
+		}
+	}
+
+	_lastTime = now;
+	_lastInstructions = instructionCount;
+}
+
+void ScriptProfiler::pushFrame(ccScript *script, ScriptCache *cache, ScriptProfileCounters *function) {
+	Frame frame;
+	frame._script = script;
+	frame._cache = cache;
+	frame._function = function;
+	frame._line = NULL;
+	frame._startTime = _lastTime;
+	if (_frames.empty())
+		frame._stack = function->_name;
+	else
+		frame._stack = _frames.back()._stack + ";" + function->_name;
+	_frames.push_back(frame);
+
+	function->_calls++;
+}
+
+void ScriptProfiler::popFrame() {
+	Frame &frame = _frames.back();
+
+	// don't count the time of recursive calls more than once
+	bool isRecursive = false;
+	for (uint i = 0; i < _frames.size() - 1; ++i)
+		if (_frames[i]._function == frame._function)
+			isRecursive = true;
+	if (!isRecursive)
+		frame._function->_totalTime += _lastTime - frame._startTime;
+
+	_frames.pop_back();
+}
+
+ScriptProfiler::ScriptCache *ScriptProfiler::getCache(ccScript *script) {
+	ScriptCache *&cache = _scriptCaches[script];
+	if (!cache)
+		cache = new ScriptCache;
+	return cache;
+}
+
+Common::String ScriptProfiler::getSectionName(ccScript *script, uint32 offset) {
+	const char *name = "script";
+	for (uint i = 0; i < script->_sections.size(); ++i) {
+		if (script->_sections[i]._offset > offset)
+			break;
+		name = script->_sections[i]._name.c_str();
+	}
+	return name;
+}
+
+Common::String ScriptProfiler::getFunctionName(ccScript *script, uint32 address) {
+	Common::String name = getSectionName(script, address) + ":";
+
+	for (uint i = 0; i < script->_exports.size(); ++i) {
+		const ScriptExport &symbol = script->_exports[i];
+		if (symbol._type != sitScriptFunction || symbol._address != address)
+			continue;
+
+		// drop the parameter count from mangled names
+		const char *mangled = strrchr(symbol._name.c_str(), '$');
+		if (mangled)
+			return name + Common::String(symbol._name.c_str(), mangled);
+		return name + symbol._name;
+	}
+
+	return name + Common::String::format("func@%d", address);
+}
+
+static bool compareCounters(const ScriptProfileCounters *a, const ScriptProfileCounters *b) {
+	if (a->_selfTime != b->_selfTime)
+		return a->_selfTime > b->_selfTime;
+	return a->_instructions > b->_instructions;
+}
+
+static void writeCounters(Common::DumpFile &file, const char *title,
+	Common::HashMap<Common::String, ScriptProfileCounters, Common::CaseSensitiveString_Hash, Common::CaseSensitiveString_EqualTo> &counters) {
+
+	Common::Array<const ScriptProfileCounters *> sorted;
+	for (Common::HashMap<Common::String, ScriptProfileCounters, Common::CaseSensitiveString_Hash, Common::CaseSensitiveString_EqualTo>::iterator i = counters.begin();
+		i != counters.end(); ++i)
+		sorted.push_back(&i->_value);
+	Common::sort(sorted.begin(), sorted.end(), compareCounters);
+
+	file.writeString(Common::String::format("%s (sorted by self time)\n", title));
+	file.writeString("     calls  instructions   self ms  total ms  name\n");
+	for (uint i = 0; i < sorted.size(); ++i) {
+		const ScriptProfileCounters *entry = sorted[i];
+		file.writeString(Common::String::format("%10d  %12d  %8d  %8d  %s\n", entry->_calls,
+			entry->_instructions, entry->_selfTime, entry->_totalTime, entry->_name.c_str()));
+	}
+	file.writeString("\n");
+}
+
+void ScriptProfiler::writeReport(const Common::String &filename) {
+	Common::DumpFile file;
+	if (!file.open(filename)) {
+		warning("ScriptProfiler: couldn't open '%s' for writing", filename.c_str());
+		return;
+	}
+
+	// (for lines, 'calls' is the number of times the line was reached)
+	writeCounters(file, "Script functions", _functions);
+	writeCounters(file, "System functions", _systemFunctions);
+	writeCounters(file, "Script lines", _lines);
+
+	debug(1, "wrote script profile to '%s'", filename.c_str());
+}
+
+void ScriptProfiler::writeCollapsedStacks(const Common::String &filename) {
+	Common::DumpFile file;
+	if (!file.open(filename)) {
+		warning("ScriptProfiler: couldn't open '%s' for writing", filename.c_str());
+		return;
+	}
+
+	// one line per stack, with the milliseconds spent there
+	for (Common::HashMap<Common::String, uint32, Common::CaseSensitiveString_Hash, Common::CaseSensitiveString_EqualTo>::iterator i = _stacks.begin();
+		i != _stacks.end(); ++i)
+		file.writeString(Common::String::format("%s %d\n", i->_key.c_str(), i->_value));
+
+	debug(1, "wrote collapsed script stacks to '%s'", filename.c_str());
+}
+
+} // End of namespace AGS
@@ -0,0 +1,114 @@
+/* ScummVM - Graphic Adventure Engine
+ *
+ * ScummVM is the legal property of its developers, whose names
+ * are too numerous to list here. Please refer to the COPYRIGHT
+ * file distributed with this source distribution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef AGS_SCRIPTPROFILER_H
+#define AGS_SCRIPTPROFILER_H
+
+#include "common/array.h"
+#include "common/hash-str.h"
+#include "common/hashmap.h"
+#include "common/str.h"
+
+namespace AGS {
+
+struct ccScript;
+struct ScriptSystemFunctionInfo;
+
+struct ScriptProfileCounters {
+	ScriptProfileCounters() : _calls(0), _instructions(0), _selfTime(0), _totalTime(0) { }
+
+	Common::String _name;
+	uint32 _calls;
+	uint32 _instructions;
+	// in milliseconds
+	uint32 _selfTime;
+	uint32 _totalTime;
+};
+
+struct ScriptProfilePointerHash {
+	uint operator()(const void *ptr) const { return (uint)((size_t)ptr >> 2); }
+};
+
+// Collects instruction counts and times for script functions, script lines
+// and system functions, enabled with the 'profile' debug channel.
+// Times come from OSystem::getMillis, and are charged to whatever was running
+// when the clock ticked over, so they're only meaningful in aggregate.
+class ScriptProfiler {
+public:
+	ScriptProfiler();
+	~ScriptProfiler();
+
+	void enterFunction(ccScript *script, uint32 address, uint32 instructionCount);
+	void leaveFunction(uint32 instructionCount);
+	void enterSystemFunction(const ScriptSystemFunctionInfo *function, uint32 instructionCount);
+	void leaveSystemFunction(uint32 instructionCount);
+	void setLine(uint32 offset, uint32 line, uint32 instructionCount);
+
+	// the script is going away (and its address might be reused)
+	void forgetScript(ccScript *script);
+
+	void writeReport(const Common::String &filename);
+	void writeCollapsedStacks(const Common::String &filename);
+
+protected:
+	typedef Common::HashMap<Common::String, ScriptProfileCounters, Common::CaseSensitiveString_Hash, Common::CaseSensitiveString_EqualTo> CounterMap;
+
+	// per-script lookups, so we don't have to build names every time
+	struct ScriptCache {
+		// by function address
+		Common::HashMap<uint32, ScriptProfileCounters *> _functions;
+		// by offset of the line number instruction
+		Common::HashMap<uint32, ScriptProfileCounters *> _lines;
+	};
+
+	struct Frame {
+		ccScript *_script;
+		ScriptCache *_cache;
+		ScriptProfileCounters *_function;
+		ScriptProfileCounters *_line;
+		uint32 _startTime;
+		// the collapsed stack, including this frame
+		Common::String _stack;
+	};
+
+	CounterMap _functions;
+	CounterMap _lines;
+	CounterMap _systemFunctions;
+	Common::HashMap<Common::String, uint32, Common::CaseSensitiveString_Hash, Common::CaseSensitiveString_EqualTo> _stacks;
+
+	Common::HashMap<const ccScript *, ScriptCache *, ScriptProfilePointerHash> _scriptCaches;
+	Common::HashMap<const ScriptSystemFunctionInfo *, ScriptProfileCounters *, ScriptProfilePointerHash> _systemFunctionCache;
+
+	Common::Array<Frame> _frames;
+	uint32 _lastTime;
+	uint32 _lastInstructions;
+
+	void update(uint32 instructionCount);
+	void pushFrame(ccScript *script, ScriptCache *cache, ScriptProfileCounters *function);
+	void popFrame();
+	ScriptCache *getCache(ccScript *script);
+	Common::String getSectionName(ccScript *script, uint32 offset);
+	Common::String getFunctionName(ccScript *script, uint32 address);
+};
+
+} // End of namespace AGS
+
+#endif // AGS_SCRIPTPROFILER_H
@@ -24,10 +24,16 @@
  * You may also modify/distribute the code in this file under that license.
  */
 
+#include "common/algorithm.h"
+#include "common/config-manager.h"
 #include "common/debug.h"
+#include "common/memstream.h"
+#include "common/savefile.h"
+#include "common/system.h"
 
 #include "engines/ags/ags.h"
 #include "engines/ags/constants.h"
+#include "engines/ags/drawable.h"
 #include "engines/ags/gamefile.h"
 #include "engines/ags/graphics.h"
 #include "engines/ags/sprites.h"
@@ -36,16 +42,31 @@
 
 namespace AGS {
 
+static void convertSpriteBits(const byte *src, uint32 srcSize, bool compressed, uint srcBpp,
+	Graphics::Surface *dest, const uint32 *lut);
+
 Sprite::~Sprite() {
-	_surface->free();
+	if (_ownsPixels)
+		_surface->free();
 	delete _surface;
 }
 
+// default memory budget for decoded sprites (in KB)
+#define DEFAULT_SPRITE_CACHE_SIZE (20 * 1024)
+
 const char *kSpriteFileSignature = " Sprite File ";
 const char *kSpriteIndexFilename = "sprindex.dat";
 const char *kSpriteIndexSignature = "SPRINDEX";
+// the index we generate ourselves if the game doesn't have one
+const char *kSpriteIndexCacheFilename = "sprindex.cache";
+
+SpriteSet::SpriteSet(AGSEngine *vm, Common::SeekableReadStream *stream) : _vm(vm), _stream(stream), _fileData(NULL),
+	_cacheSize(0), _cacheTick(0), _frameStartTick(0), _cacheHits(0), _cacheMisses(0), _cacheEvictions(0),
+	_cachePrefetches(0), _transformCacheSize(0) {
+	// the budget is configured in kilobytes, like in the original's setup
+	ConfMan.registerDefault("sprite_cache_size", DEFAULT_SPRITE_CACHE_SIZE);
+	_cacheBudget = MAX(0, ConfMan.getInt("sprite_cache_size")) * 1024;
 
-SpriteSet::SpriteSet(AGSEngine *vm, Common::SeekableReadStream *stream) : _vm(vm), _stream(stream) {
 	uint16 version = _stream->readUint16LE();
 
 	char signature[13 + 1];
@@ -74,6 +95,27 @@ SpriteSet::SpriteSet(AGSEngine *vm, Common::SeekableReadStream *stream) : _vm(vm
 		_stream->skip(256 * 3); // palette
 	}
 
+	// uncompressed sprites can be used straight from the file data, if we keep it all in memory;
+	// that comes out of the cache budget, so only do it if the whole file fits
+	ConfMan.registerDefault("sprite_file_in_memory", false);
+	if (!_spritesAreCompressed && ConfMan.getBool("sprite_file_in_memory") && (uint32)_stream->size() <= _cacheBudget) {
+		uint32 pos = _stream->pos();
+		uint32 size = _stream->size();
+		_fileData = (byte *)malloc(size);
+		if (_fileData) {
+			_cacheBudget -= size;
+			_stream->seek(0);
+			if (_stream->read(_fileData, size) != size)
+				error("failed to read sprite file");
+			delete _stream;
+			_stream = new Common::MemoryReadStream(_fileData, size, DisposeAfterUse::YES);
+			_stream->seek(pos);
+			debug(2, "loaded %d bytes of sprite file into memory", size);
+		} else {
+			warning("not enough memory to load the sprite file (%d bytes)", size);
+		}
+	}
+
 	uint16 spriteCount = _stream->readUint16LE();
 	if (version < 4)
 		spriteCount = 200;
@@ -82,9 +124,21 @@ SpriteSet::SpriteSet(AGSEngine *vm, Common::SeekableReadStream *stream) : _vm(vm
 	debug(2, "sprite set has %d sprites (version %d, %s)", spriteCount, version, _spritesAreCompressed ? "compressed" : "uncompressed");
 
 	// try and load the sprite index file first
-	if (loadSpriteIndexFile(spriteFileID))
+	if (loadSpriteIndexFile(_vm->getFile(kSpriteIndexFilename), spriteFileID))
 		return;
 
+	// then one we generated on an earlier run, if it's for this sprite file
+	Common::String cacheFilename = _vm->wrapFilename(kSpriteIndexCacheFilename);
+	Common::SeekableReadStream *cacheStream = _vm->getSaveFileManager()->openForLoading(cacheFilename);
+	if (cacheStream) {
+		if (cacheStream->readUint32LE() != (uint32)_stream->size()) {
+			delete cacheStream;
+			cacheStream = NULL;
+		}
+		if (loadSpriteIndexFile(cacheStream, spriteFileID))
+			return;
+	}
+
 	// no sprite index file, manually index the sprites
 	for (uint i = 0; i <= spriteCount; ++i) {
 		SpriteInfo &info = _spriteInfo[i];
@@ -105,17 +159,27 @@ SpriteSet::SpriteSet(AGSEngine *vm, Common::SeekableReadStream *stream) : _vm(vm
 
 	if (_stream->eos())
 		error("failed to read sprite file");
+
+	saveSpriteIndexFile(cacheFilename, spriteFileID);
 }
 
 SpriteSet::~SpriteSet() {
+	debug(1, "sprite cache: %d hits, %d misses, %d evictions, %d prefetched, %d bytes in use",
+		_cacheHits, _cacheMisses, _cacheEvictions, _cachePrefetches, _cacheSize);
+
 	delete _stream;
 
 	for (Common::HashMap<uint, Sprite *>::iterator i = _sprites.begin(); i != _sprites.end(); ++i)
 		delete i->_value;
+
+	for (Common::HashMap<TransformKey, TransformedSprite, TransformKeyHash>::iterator i = _transformCache.begin();
+		i != _transformCache.end(); ++i) {
+		i->_value._surface->free();
+		delete i->_value._surface;
+	}
 }
 
-bool SpriteSet::loadSpriteIndexFile(uint32 spriteFileID) {
-	Common::SeekableReadStream *idxStream = _vm->getFile(kSpriteIndexFilename);
+bool SpriteSet::loadSpriteIndexFile(Common::SeekableReadStream *idxStream, uint32 spriteFileID) {
 	if (!idxStream)
 		return false;
 
@@ -170,6 +234,37 @@ bool SpriteSet::loadSpriteIndexFile(uint32 spriteFileID) {
 	return true;
 }
 
+// writes the index in the same format as sprindex.dat (version 2),
+// preceded by the size of the sprite file it belongs to
+void SpriteSet::saveSpriteIndexFile(const Common::String &filename, uint32 spriteFileID) {
+	Common::OutSaveFile *idxStream = _vm->getSaveFileManager()->openForSaving(filename, false);
+	if (!idxStream) {
+		warning("couldn't create sprite index file '%s'", filename.c_str());
+		return;
+	}
+
+	uint32 spriteCount = _spriteInfo.size();
+	idxStream->writeUint32LE(_stream->size());
+	idxStream->write(kSpriteIndexSignature, 8);
+	idxStream->writeUint32LE(2);
+	idxStream->writeUint32LE(spriteFileID);
+	idxStream->writeUint32LE(spriteCount - 1);
+	idxStream->writeUint32LE(spriteCount);
+	for (uint i = 0; i < spriteCount; ++i)
+		idxStream->writeUint16LE(_spriteInfo[i]._width);
+	for (uint i = 0; i < spriteCount; ++i)
+		idxStream->writeUint16LE(_spriteInfo[i]._height);
+	for (uint i = 0; i < spriteCount; ++i)
+		idxStream->writeUint32LE(_spriteInfo[i]._offset);
+
+	idxStream->finalize();
+	if (idxStream->err())
+		warning("failed to write sprite index file '%s'", filename.c_str());
+	else
+		debug(2, "wrote sprite index file '%s'", filename.c_str());
+	delete idxStream;
+}
+
 Sprite *SpriteSet::getSprite(uint32 spriteId) {
 	if (spriteId >= _spriteInfo.size())
 		error("SpriteSet::getSprite: sprite id %d is too high", spriteId);
@@ -180,9 +275,22 @@ Sprite *SpriteSet::getSprite(uint32 spriteId) {
 		spriteId = 0;
 	}
 
-	if (_sprites.contains(spriteId))
-		return _sprites[spriteId];
+	Common::HashMap<uint, Sprite *>::iterator i = _sprites.find(spriteId);
+	if (i != _sprites.end()) {
+		_cacheHits++;
+		i->_value->_lastUsed = ++_cacheTick;
+		return i->_value;
+	}
+	_cacheMisses++;
+
+	Sprite *sprite = loadSprite(spriteId);
+	if (sprite && _cacheSize > _cacheBudget)
+		trimCache();
 
+	return sprite;
+}
+
+Sprite *SpriteSet::loadSprite(uint32 spriteId) {
 	_stream->seek(_spriteInfo[spriteId]._offset);
 	uint16 colorDepth = _stream->readUint16LE();
 
@@ -209,62 +317,91 @@ Sprite *SpriteSet::getSprite(uint32 spriteId) {
 	_spriteInfo[spriteId]._width = _stream->readUint16LE();
 	_spriteInfo[spriteId]._height = _stream->readUint16LE();
 
-	Graphics::Surface *surface = new Graphics::Surface;
-	surface->create(_spriteInfo[spriteId]._width, _spriteInfo[spriteId]._height, format);
-
-	if (_spritesAreCompressed) {
-		_stream->skip(4); // data size, FIXME: use this
-		switch (colorDepth) {
-		case 1:
-			_stream->skip(2); // data size, FIXME: use this
-			unpackSpriteBits(_stream, (byte *)surface->getPixels(), surface->w * surface->h);
-			break;
-		case 2:
-			unpackSpriteBits16(_stream, (uint16 *)surface->getPixels(), surface->w * surface->h);
-			break;
-		case 4:
-			unpackSpriteBits32(_stream, (uint32 *)surface->getPixels(), surface->w * surface->h);
-			break;
-		}
-	} else {
-		_stream->read((byte *)surface->getPixels(), surface->w * surface->h * colorDepth);
-	}
-
 	Graphics::PixelFormat nativeFormat = _vm->_graphics->getPixelFormat();
-	if (format != nativeFormat && !(format.bytesPerPixel == 4 && nativeFormat.bytesPerPixel == 4)) {
-		// FIXME: converting downward?
+	bool needsConversion = (format != nativeFormat && !(format.bytesPerPixel == 4 && nativeFormat.bytesPerPixel == 4));
+
+#ifdef SCUMM_LITTLE_ENDIAN
+	// (sprite headers are 6 bytes, so 16/32bpp pixels are often misaligned; copy those)
+	uint32 pixelsSize = _spriteInfo[spriteId]._width * _spriteInfo[spriteId]._height * colorDepth;
+	if (_fileData && !needsConversion && _stream->pos() + pixelsSize <= (uint32)_stream->size()
+		&& reinterpret_cast<uintptr>(_fileData + _stream->pos()) % colorDepth == 0) {
+		// point straight at the pixels in the file data, no copy needed
+		Graphics::Surface *surface = new Graphics::Surface;
+		surface->init(_spriteInfo[spriteId]._width, _spriteInfo[spriteId]._height,
+			_spriteInfo[spriteId]._width * colorDepth, _fileData + _stream->pos(), format);
+
+		Sprite *sprite = new Sprite(spriteId, surface);
+		sprite->_ownsPixels = false;
+		sprite->_lastUsed = ++_cacheTick;
+		_sprites[spriteId] = sprite;
+		return sprite;
+	}
+#endif
 
+	// upward conversions are done while decoding, using a lookup table
+	uint32 paletteLUT[256];
+	const uint32 *lut = NULL;
+	if (needsConversion && format.bytesPerPixel < nativeFormat.bytesPerPixel) {
 		debug(3, "converting sprite from %dBpp to %dBpp", format.bytesPerPixel, nativeFormat.bytesPerPixel);
 
-		byte myPalette[256 * 3];
 		if (format.bytesPerPixel == 1) {
-			// Converting from a paletted image, make a copy of the palette
-			// and fix the transparency.
+			// converting from a paletted image, using the current palette
+			// (with the transparency fixed)
+			const byte *palette = _vm->_graphics->getPalette();
+			paletteLUT[0] = _vm->_graphics->getTransparentColor();
+			for (uint i = 1; i < 256; ++i)
+				paletteLUT[i] = nativeFormat.RGBToColor(palette[i * 3], palette[i * 3 + 1], palette[i * 3 + 2]);
+			lut = paletteLUT;
+		} else {
+			lut = get16To32LUT(format, nativeFormat);
+		}
+	}
+
+	Graphics::Surface *surface = new Graphics::Surface;
+	surface->create(_spriteInfo[spriteId]._width, _spriteInfo[spriteId]._height, lut ? nativeFormat : format);
 
-			memcpy(myPalette, _vm->_graphics->getPalette(), 256 * 3);
-			uint32 transColor = _vm->_graphics->getTransparentColor();
-			nativeFormat.colorToRGB(transColor, myPalette[0], myPalette[1], myPalette[2]);
+	if (_spritesAreCompressed || lut) {
+		uint32 dataSize;
+		if (_spritesAreCompressed) {
+			dataSize = _stream->readUint32LE();
+			if (colorDepth == 1)
+				_stream->skip(2); // FIXME: what is this?
+		} else {
+			dataSize = surface->w * surface->h * colorDepth;
 		}
 
-		Graphics::Surface *convertedSurf = surface->convertTo(nativeFormat, myPalette);
-
-		if (format.bytesPerPixel == 2 && nativeFormat.bytesPerPixel == 4) {
-			// Converted 16bpp->32bpp, fix the transparency.
-
-			uint16 transColor16 = (uint16)_vm->_graphics->getTransparentColor(2);
-			uint32 transColor32 = _vm->_graphics->getTransparentColor();
-			for (uint y = 0; y < surface->h; ++y) {
-				uint16 *src = (uint16 *)surface->getBasePtr(0, y);
-				uint32 *dest = (uint32 *)convertedSurf->getBasePtr(0, y);
-				for (uint x = 0; x < surface->w; ++x) {
-					if (*src == transColor16)
-						*dest = transColor32;
-					src++;
-					dest++;
-				}
+		// read the whole block in one go, and decode it from memory
+		dataSize = MIN<uint32>(dataSize, _stream->size() - _stream->pos());
+		_readBuffer.resize(dataSize);
+		if (dataSize)
+			dataSize = _stream->read(&_readBuffer[0], dataSize);
+		const byte *data = dataSize ? &_readBuffer[0] : NULL;
+
+		if (lut) {
+			convertSpriteBits(data, dataSize, _spritesAreCompressed, colorDepth, surface, lut);
+		} else {
+			switch (colorDepth) {
+			case 1:
+				unpackSpriteBits(data, dataSize, (byte *)surface->getPixels(), surface->w * surface->h);
+				break;
+			case 2:
+				unpackSpriteBits16(data, dataSize, (uint16 *)surface->getPixels(), surface->w * surface->h);
+				break;
+			case 4:
+				unpackSpriteBits32(data, dataSize, (uint32 *)surface->getPixels(), surface->w * surface->h);
+				break;
 			}
 		}
+	} else {
+		_stream->read((byte *)surface->getPixels(), surface->w * surface->h * colorDepth);
+	}
+
+	if (needsConversion && !lut) {
+		// FIXME: converting downward?
 
+		debug(3, "converting sprite from %dBpp to %dBpp", format.bytesPerPixel, nativeFormat.bytesPerPixel);
+
+		Graphics::Surface *convertedSurf = surface->convertTo(nativeFormat);
 		surface->free();
 		delete surface;
 		surface = convertedSurf;
@@ -273,88 +410,415 @@ Sprite *SpriteSet::getSprite(uint32 spriteId) {
 	// FIXME
 
 	Sprite *sprite = new Sprite(spriteId, surface);
+	sprite->_lastUsed = ++_cacheTick;
 	_sprites[spriteId] = sprite;
+	_cacheSize += surface->pitch * surface->h;
+
 	return sprite;
 }
 
-void unpackSpriteBits(Common::SeekableReadStream *stream, byte *dest, uint32 size) {
-	uint32 offset = 0;
+const uint32 *SpriteSet::get16To32LUT(const Graphics::PixelFormat &srcFormat, const Graphics::PixelFormat &destFormat) {
+	if (!_lut16To32.empty())
+		return &_lut16To32[0];
 
-	while (!stream->eos() && (offset < size)) {
-		signed char n = (signed char)stream->readByte();
+	_lut16To32.resize(65536);
+	for (uint i = 0; i < 65536; ++i) {
+		byte r, g, b;
+		srcFormat.colorToRGB(i, r, g, b);
+		_lut16To32[i] = destFormat.RGBToColor(r, g, b);
+	}
 
-		if (n == -128)
-			n = 0;
+	// keep the transparency
+	_lut16To32[_vm->_graphics->getTransparentColor(2)] = _vm->_graphics->getTransparentColor();
 
-		if (n < 0) {
-			// run of a single byte
-			uint32 count = 1 - n;
-			byte data = stream->readByte();
-			while (count-- && (offset < size)) {
-				dest[offset++] = data;
-			}
-		} else {
-			// run of non-encoded bytes
-			uint32 count = 1 + n;
-			while (count-- && (offset < size)) {
-				dest[offset++] = stream->readByte();
-			}
+	return &_lut16To32[0];
+}
+
+void SpriteSet::prefetch(const Common::Array<uint32> &spriteIds) {
+	// whatever was still queued was for the previous room
+	_prefetchQueue.clear();
+
+	for (uint i = 0; i < spriteIds.size(); ++i) {
+		uint32 spriteId = spriteIds[i];
+		if (spriteId >= _spriteInfo.size() || !_spriteInfo[spriteId]._offset)
+			continue;
+		if (_sprites.contains(spriteId))
+			continue;
+		_prefetchQueue.push(spriteId);
+	}
+
+	debug(3, "%d sprites queued for prefetching", _prefetchQueue.size());
+}
+
+bool SpriteSet::prefetchSome(uint32 maxMillis) {
+	uint32 startTime = g_system->getMillis();
+
+	while (!_prefetchQueue.empty()) {
+		// don't push anything out of the cache to make room
+		if (_cacheSize >= _cacheBudget) {
+			_prefetchQueue.clear();
+			break;
 		}
+
+		uint32 spriteId = _prefetchQueue.pop();
+		// (it might have been needed, and so decoded, in the meantime)
+		if (!_sprites.contains(spriteId) && loadSprite(spriteId))
+			_cachePrefetches++;
+
+		if (g_system->getMillis() - startTime >= maxMillis)
+			break;
 	}
+
+	return !_prefetchQueue.empty();
 }
 
-void unpackSpriteBits16(Common::SeekableReadStream *stream, uint16 *dest, uint32 size) {
-	uint32 offset = 0;
+Sprite *SpriteSet::acquireSprite(uint32 spriteId) {
+	Sprite *sprite = getSprite(spriteId);
+	if (sprite)
+		sprite->_refCount++;
+	return sprite;
+}
 
-	while (!stream->eos() && (offset < size)) {
-		signed char n = (signed char)stream->readByte();
+void SpriteSet::releaseSprite(Sprite *sprite) {
+	assert(sprite->_refCount);
+	sprite->_refCount--;
+}
 
-		if (n == -128)
-			n = 0;
+void SpriteSet::frameDone() {
+	trimTransformCache();
 
-		if (n < 0) {
-			// run of a single pixel
-			uint32 count = 1 - n;
-			uint16 data = stream->readUint16LE();
-			while (count-- && (offset < size)) {
-				dest[offset++] = data;
+	// nothing drawn so far is needed any more
+	_frameStartTick = ++_cacheTick;
+	if (_cacheSize > _cacheBudget)
+		trimCache();
+}
+
+struct SpriteLastUsedLess {
+	bool operator()(const Sprite *a, const Sprite *b) const {
+		return a->_lastUsed < b->_lastUsed;
+	}
+};
+
+void SpriteSet::trimCache() {
+	// only sprites which are neither acquired nor used in this frame can go
+	Common::Array<Sprite *> candidates;
+	for (Common::HashMap<uint, Sprite *>::iterator i = _sprites.begin(); i != _sprites.end(); ++i) {
+		Sprite *sprite = i->_value;
+		if (sprite->_refCount || sprite->_lastUsed >= _frameStartTick)
+			continue;
+		candidates.push_back(sprite);
+	}
+	if (candidates.empty())
+		return;
+
+	Common::sort(candidates.begin(), candidates.end(), SpriteLastUsedLess());
+
+	// free some extra, so we don't end up doing this for every new sprite
+	uint32 target = _cacheBudget - _cacheBudget / 8;
+	uint count = 0;
+	while (_cacheSize > target && count < candidates.size()) {
+		Sprite *sprite = candidates[count++];
+		if (sprite->_ownsPixels)
+			_cacheSize -= sprite->_surface->pitch * sprite->_surface->h;
+		_vm->_graphics->forgetSurface(sprite->_surface);
+		_sprites.erase(sprite->_id);
+		delete sprite;
+	}
+	_cacheEvictions += count;
+
+	debug(3, "sprite cache: evicted %d sprites, %d bytes now in use (%d hits, %d misses, %d evictions)",
+		count, _cacheSize, _cacheHits, _cacheMisses, _cacheEvictions);
+}
+
+// the memory we allow scaled/tinted sprites to use, between frames
+#define SPRITE_TRANSFORM_CACHE_SIZE (8 * 1024 * 1024)
+
+bool SpriteTransform::operator==(const SpriteTransform &other) const {
+	return _scale == other._scale && _lightLevel == other._lightLevel && _tintAmount == other._tintAmount
+		&& _tintLuminance == other._tintLuminance && _tintRed == other._tintRed
+		&& _tintGreen == other._tintGreen && _tintBlue == other._tintBlue;
+}
+
+void SpriteTransform::setLighting(Drawable *item) {
+	_lightLevel = item->getDrawLightLevel();
+
+	int tintAmount = 0, tintLuminance = 255;
+	item->getDrawTint(tintAmount, tintLuminance, _tintRed, _tintGreen, _tintBlue);
+	_tintAmount = CLIP(tintAmount, 0, 100);
+	_tintLuminance = CLIP(tintLuminance, 0, 255);
+	if (!_tintAmount)
+		_tintRed = _tintGreen = _tintBlue = 0;
+}
+
+uint SpriteSet::TransformKeyHash::operator()(const TransformKey &key) const {
+	const SpriteTransform &transform = key._transform;
+	uint hash = key._spriteId;
+	hash = hash * 31 + transform._scale;
+	hash = hash * 31 + (uint)transform._lightLevel;
+	hash = hash * 31 + transform._tintAmount;
+	hash = hash * 31 + transform._tintLuminance;
+	hash = hash * 31 + (transform._tintRed | (transform._tintGreen << 8) | (transform._tintBlue << 16));
+	return hash;
+}
+
+// 'tint_image' and the lighting part of 'draw_sprite_support' in original
+static uint32 recolorPixel(const Graphics::PixelFormat &format, uint32 pixel, const SpriteTransform &transform) {
+	byte a, r, g, b;
+	format.colorToARGB(pixel, a, r, g, b);
+	int color[3] = { r, g, b };
+
+	if (transform._tintAmount) {
+		// use the hue and saturation of the tint, but the brightness of the pixel
+		int value = MAX(r, MAX(g, b)) * transform._tintLuminance / 255;
+		int tint[3] = { transform._tintRed, transform._tintGreen, transform._tintBlue };
+		int tintMax = MAX(tint[0], MAX(tint[1], tint[2]));
+		for (uint i = 0; i < 3; ++i) {
+			int tinted = tintMax ? (tint[i] * value / tintMax) : value;
+			color[i] += (tinted - color[i]) * (int)transform._tintAmount / 100;
+		}
+	} else if (transform._lightLevel > 0) {
+		for (uint i = 0; i < 3; ++i)
+			color[i] += (255 - color[i]) * transform._lightLevel / 100;
+	} else if (transform._lightLevel < 0) {
+		for (uint i = 0; i < 3; ++i)
+			color[i] = color[i] * (100 + transform._lightLevel) / 100;
+	}
+
+	return format.ARGBToColor(a, color[0], color[1], color[2]);
+}
+
+// 'stretch_sprite' plus the above in original (nearest-neighbour, like Allegro)
+static Graphics::Surface *transformSprite(const Graphics::Surface *src, const SpriteTransform &transform, uint32 transColor) {
+	uint width = MAX<uint>(1, src->w * transform._scale / 100);
+	uint height = MAX<uint>(1, src->h * transform._scale / 100);
+	// 8bpp sprites would need palette tricks for lighting, so they only get scaled
+	bool recolor = (src->format.bytesPerPixel > 1) && (transform._lightLevel || transform._tintAmount);
+
+	Graphics::Surface *dest = new Graphics::Surface;
+	dest->create(width, height, src->format);
+
+	for (uint y = 0; y < height; ++y) {
+		uint srcY = y * src->h / height;
+		for (uint x = 0; x < width; ++x) {
+			uint srcX = x * src->w / width;
+			switch (src->format.bytesPerPixel) {
+			case 1:
+				*(byte *)dest->getBasePtr(x, y) = *(const byte *)src->getBasePtr(srcX, srcY);
+				break;
+			case 2: {
+				uint16 pixel = *(const uint16 *)src->getBasePtr(srcX, srcY);
+				if (recolor && pixel != transColor) {
+					pixel = (uint16)recolorPixel(src->format, pixel, transform);
+					// don't accidentally make anything transparent
+					if (pixel == transColor)
+						pixel ^= 1;
+				}
+				*(uint16 *)dest->getBasePtr(x, y) = pixel;
+				break;
 			}
-		} else {
-			// run of non-encoded pixels
-			uint32 count = 1 + n;
-			while (count-- && (offset < size)) {
-				dest[offset++] = stream->readUint16LE();
+			case 4: {
+				uint32 pixel = *(const uint32 *)src->getBasePtr(srcX, srcY);
+				if (recolor && (pixel & 0xffffff) != transColor) {
+					pixel = recolorPixel(src->format, pixel, transform);
+					if ((pixel & 0xffffff) == transColor)
+						pixel ^= 1;
+				}
+				*(uint32 *)dest->getBasePtr(x, y) = pixel;
+				break;
 			}
+			default:
+				error("transformSprite: %dBpp not supported", src->format.bytesPerPixel);
+			}
+		}
+	}
+
+	return dest;
+}
+
+const Graphics::Surface *SpriteSet::getTransformedSprite(uint32 spriteId, const SpriteTransform &transform) {
+	Sprite *sprite = getSprite(spriteId);
+	if (transform.isIdentity())
+		return sprite->_surface;
+
+	TransformKey key;
+	key._spriteId = spriteId;
+	key._transform = transform;
+
+	Common::HashMap<TransformKey, TransformedSprite, TransformKeyHash>::iterator i = _transformCache.find(key);
+	if (i != _transformCache.end()) {
+		i->_value._lastUsed = ++_cacheTick;
+		return i->_value._surface;
+	}
+
+	TransformedSprite &entry = _transformCache[key];
+	entry._surface = transformSprite(sprite->_surface, transform, _vm->_graphics->getTransparentColor());
+	entry._lastUsed = ++_cacheTick;
+	_transformCacheSize += entry._surface->pitch * entry._surface->h;
+
+	return entry._surface;
+}
+
+void SpriteSet::trimTransformCache() {
+	if (_transformCacheSize <= SPRITE_TRANSFORM_CACHE_SIZE)
+		return;
+
+	debug(4, "trimming sprite transform cache (%d bytes in %d entries)", _transformCacheSize, _transformCache.size());
+
+	// throw away the oldest entries first (there aren't many, so just scan)
+	while (_transformCacheSize > SPRITE_TRANSFORM_CACHE_SIZE && !_transformCache.empty()) {
+		Common::HashMap<TransformKey, TransformedSprite, TransformKeyHash>::iterator oldest = _transformCache.begin();
+		for (Common::HashMap<TransformKey, TransformedSprite, TransformKeyHash>::iterator i = _transformCache.begin();
+			i != _transformCache.end(); ++i) {
+			if (i->_value._lastUsed < oldest->_value._lastUsed)
+				oldest = i;
 		}
+
+		Graphics::Surface *surface = oldest->_value._surface;
+		_transformCacheSize -= surface->pitch * surface->h;
+		_vm->_graphics->forgetSurface(surface);
+		surface->free();
+		delete surface;
+		_transformCache.erase(oldest);
 	}
 }
 
-void unpackSpriteBits32(Common::SeekableReadStream *stream, uint32 *dest, uint32 size) {
-	uint32 offset = 0;
+/*
+ * The sprite RLE format is a signed count byte followed by either a single
+ * pixel to repeat (1 - count) times, or (1 + count) literal pixels. These
+ * decode from memory, returning how many compressed bytes were used.
+ */
+
+template<typename PixelType>
+static inline PixelType readRLEPixel(const byte *src);
 
-	while (!stream->eos() && (offset < size)) {
-		signed char n = (signed char)stream->readByte();
+template<>
+inline byte readRLEPixel<byte>(const byte *src) {
+	return *src;
+}
+
+template<>
+inline uint16 readRLEPixel<uint16>(const byte *src) {
+	return READ_LE_UINT16(src);
+}
+
+template<>
+inline uint32 readRLEPixel<uint32>(const byte *src) {
+	return READ_LE_UINT32(src);
+}
+
+// maps decoded pixels to the destination format
+template<typename PixelType>
+struct IdentityPixelMap {
+	enum { kIsIdentity = true };
+	PixelType operator()(PixelType pixel) const { return pixel; }
+};
+
+template<typename SrcType, typename DestType>
+struct LUTPixelMap {
+	enum { kIsIdentity = false };
+	LUTPixelMap(const uint32 *lut) : _lut(lut) { }
+	DestType operator()(SrcType pixel) const { return (DestType)_lut[pixel]; }
+	const uint32 *_lut;
+};
+
+template<typename SrcType, typename DestType, class PixelMap>
+static uint32 unpackBits(const byte *src, uint32 srcSize, DestType *dest, uint32 size, const PixelMap &map) {
+	const byte *srcStart = src;
+	const byte *srcEnd = src + srcSize;
+	DestType *destEnd = dest + size;
+
+	while (src < srcEnd && dest < destEnd) {
+		int n = (signed char)*src++;
 
 		if (n == -128)
 			n = 0;
 
 		if (n < 0) {
 			// run of a single pixel
-			uint32 count = 1 - n;
-			uint32 data = stream->readUint32LE();
-			while (count-- && (offset < size)) {
-				dest[offset++] = data;
+			if (srcEnd - src < (int)sizeof(SrcType))
+				break;
+			uint32 count = MIN<uint32>(1 - n, destEnd - dest);
+			DestType data = map(readRLEPixel<SrcType>(src));
+			src += sizeof(SrcType);
+			if (sizeof(DestType) == 1) {
+				memset(dest, data, count);
+				dest += count;
+			} else {
+				while (count--)
+					*dest++ = data;
 			}
 		} else {
-			// run of non-encoded pixels
-			uint32 count = 1 + n;
-			while (count-- && (offset < size)) {
-				dest[offset++] = stream->readUint32LE();
+			// run of non-encoded pixels (we stop reading them once the destination is full)
+			uint32 count = MIN<uint32>(1 + n, destEnd - dest);
+			count = MIN<uint32>(count, (srcEnd - src) / sizeof(SrcType));
+#ifdef SCUMM_LITTLE_ENDIAN
+			if (PixelMap::kIsIdentity) {
+				memcpy(dest, src, count * sizeof(SrcType));
+				dest += count;
+				src += count * sizeof(SrcType);
+			} else
+#endif
+			{
+				for (uint32 i = 0; i < count; ++i, src += sizeof(SrcType))
+					*dest++ = map(readRLEPixel<SrcType>(src));
 			}
+			if (count < (uint32)(1 + n) && dest < destEnd)
+				break; // ran out of input
 		}
 	}
+
+	return src - srcStart;
+}
+
+template<typename SrcType, typename DestType>
+static void convertPixels(const byte *src, DestType *dest, uint32 size, const uint32 *lut) {
+	for (uint32 i = 0; i < size; ++i, src += sizeof(SrcType))
+		*dest++ = (DestType)lut[readRLEPixel<SrcType>(src)];
 }
 
+// decodes (if compressed) and converts sprite data to the format of dest,
+// which must be an upward conversion using the given lookup table
+static void convertSpriteBits(const byte *src, uint32 srcSize, bool compressed, uint srcBpp,
+	Graphics::Surface *dest, const uint32 *lut) {
+	uint32 size = dest->w * dest->h;
+	uint destBpp = dest->format.bytesPerPixel;
+
+	if (!compressed && srcSize < size * srcBpp) {
+		// truncated, leave the rest blank
+		memset(dest->getPixels(), 0, size * destBpp);
+		size = srcSize / srcBpp;
+	}
 
+	if (srcBpp == 1 && destBpp == 2) {
+		if (compressed)
+			unpackBits<byte>(src, srcSize, (uint16 *)dest->getPixels(), size, LUTPixelMap<byte, uint16>(lut));
+		else
+			convertPixels<byte>(src, (uint16 *)dest->getPixels(), size, lut);
+	} else if (srcBpp == 1 && destBpp == 4) {
+		if (compressed)
+			unpackBits<byte>(src, srcSize, (uint32 *)dest->getPixels(), size, LUTPixelMap<byte, uint32>(lut));
+		else
+			convertPixels<byte>(src, (uint32 *)dest->getPixels(), size, lut);
+	} else if (srcBpp == 2 && destBpp == 4) {
+		if (compressed)
+			unpackBits<uint16>(src, srcSize, (uint32 *)dest->getPixels(), size, LUTPixelMap<uint16, uint32>(lut));
+		else
+			convertPixels<uint16>(src, (uint32 *)dest->getPixels(), size, lut);
+	} else {
+		error("convertSpriteBits: can't convert from %dBpp to %dBpp", srcBpp, destBpp);
+	}
+}
+
+uint32 unpackSpriteBits(const byte *src, uint32 srcSize, byte *dest, uint32 size) {
+	return unpackBits<byte>(src, srcSize, dest, size, IdentityPixelMap<byte>());
+}
+
+uint32 unpackSpriteBits16(const byte *src, uint32 srcSize, uint16 *dest, uint32 size) {
+	return unpackBits<uint16>(src, srcSize, dest, size, IdentityPixelMap<uint16>());
+}
+
+uint32 unpackSpriteBits32(const byte *src, uint32 srcSize, uint32 *dest, uint32 size) {
+	return unpackBits<uint32>(src, srcSize, dest, size, IdentityPixelMap<uint32>());
+}
 
 } // End of namespace AGS
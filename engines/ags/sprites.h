@@ -28,17 +28,21 @@
 #define AGS_SPRITES_H
 
 #include "common/array.h"
+#include "common/hashmap.h"
+#include "common/queue.h"
 #include "common/stream.h"
 
 namespace Graphics {
+	struct PixelFormat;
 	struct Surface;
 }
 
 namespace AGS {
 
-void unpackSpriteBits(Common::SeekableReadStream *stream, byte *dest, uint32 size);
-void unpackSpriteBits16(Common::SeekableReadStream *stream, uint16 *dest, uint32 size);
-void unpackSpriteBits32(Common::SeekableReadStream *stream, uint32 *dest, uint32 size);
+// these return the number of bytes of compressed data used
+uint32 unpackSpriteBits(const byte *src, uint32 srcSize, byte *dest, uint32 size);
+uint32 unpackSpriteBits16(const byte *src, uint32 srcSize, uint16 *dest, uint32 size);
+uint32 unpackSpriteBits32(const byte *src, uint32 srcSize, uint32 *dest, uint32 size);
 
 struct SpriteInfo {
 	uint32 _offset;
@@ -46,12 +50,35 @@ struct SpriteInfo {
 };
 
 struct Sprite {
-	Sprite(uint spriteId, Graphics::Surface *surf) : _id(spriteId), _surface(surf), _refCount(0) { }
+	Sprite(uint spriteId, Graphics::Surface *surf) : _id(spriteId), _surface(surf), _ownsPixels(true),
+		_refCount(0), _lastUsed(0) { }
 	~Sprite();
 
 	uint _id;
 	Graphics::Surface *_surface;
+	// false if the pixels point into the sprite file data
+	bool _ownsPixels;
 	uint _refCount;
+	uint32 _lastUsed;
+};
+
+// how a sprite should be changed before being drawn
+// (mirroring isn't included, the blitter does that for free)
+struct SpriteTransform {
+	SpriteTransform() : _scale(100), _lightLevel(0), _tintAmount(0), _tintLuminance(255),
+		_tintRed(0), _tintGreen(0), _tintBlue(0) { }
+
+	bool isIdentity() const { return _scale == 100 && !_lightLevel && !_tintAmount; }
+	bool operator==(const SpriteTransform &other) const;
+
+	// fills in the light level and tint using the drawable's settings
+	void setLighting(class Drawable *item);
+
+	uint _scale; // percentage
+	int _lightLevel; // -100 (black) to 100 (white)
+	uint _tintAmount; // 0 (none) to 100
+	uint _tintLuminance; // 0 to 255
+	byte _tintRed, _tintGreen, _tintBlue;
 };
 
 class AGSEngine;
@@ -64,19 +91,82 @@ public:
 	uint getSpriteCount() { return _spriteInfo.size(); }
 	uint getSpriteWidth(uint id) { return _spriteInfo[id]._width; }
 	uint getSpriteHeight(uint id) { return _spriteInfo[id]._height; }
+	// sprites returned by getSprite stay valid until the end of the frame,
+	// anything which wants to keep one for longer must acquire/release it
 	Sprite *getSprite(uint32 spriteId);
+	Sprite *acquireSprite(uint32 spriteId);
 	void releaseSprite(Sprite *sprite);
 
+	// called once the current frame has been drawn
+	void frameDone();
+	// changes after every frameDone, so drawables can reuse a surface within a frame
+	uint32 getFrameTick() const { return _frameStartTick; }
+
+	// queues sprites which are likely to be needed soon (replacing any
+	// still queued); they're decoded in the background by prefetchSome
+	void prefetch(const Common::Array<uint32> &spriteIds);
+	// decodes queued sprites for up to the given time, returning
+	// false once the queue is empty (or the cache is full)
+	bool prefetchSome(uint32 maxMillis);
+
+	// returns a scaled/tinted copy of a sprite, which remains valid until
+	// the next trimTransformCache call
+	const Graphics::Surface *getTransformedSprite(uint32 spriteId, const SpriteTransform &transform);
 protected:
 	AGSEngine *_vm;
 	Common::SeekableReadStream *_stream;
 	bool _spritesAreCompressed;
+	// the whole sprite file, if it was loaded into memory (owned by _stream)
+	byte *_fileData;
 	Common::Array<SpriteInfo> _spriteInfo;
 
 	// id->sprite mapping
 	Common::HashMap<uint, Sprite *> _sprites;
 
-	bool loadSpriteIndexFile(uint32 spriteFileID);
+	// the memory used by (and allowed for) decoded sprites, in bytes
+	uint32 _cacheSize, _cacheBudget;
+	// sprites used since this tick are in use by the current frame
+	uint32 _cacheTick, _frameStartTick;
+	uint32 _cacheHits, _cacheMisses, _cacheEvictions;
+
+	// (reused, to avoid an allocation for every sprite)
+	Common::Array<byte> _readBuffer;
+	// for converting 16bpp sprites to 32bpp, built when first needed
+	Common::Array<uint32> _lut16To32;
+
+	Common::Queue<uint32> _prefetchQueue;
+	uint32 _cachePrefetches;
+
+	Sprite *loadSprite(uint32 spriteId);
+	const uint32 *get16To32LUT(const Graphics::PixelFormat &srcFormat, const Graphics::PixelFormat &destFormat);
+	void trimCache();
+	// throws away the least recently used transformed sprites, if needed
+	void trimTransformCache();
+
+	// takes ownership of the stream (which may be NULL)
+	bool loadSpriteIndexFile(Common::SeekableReadStream *idxStream, uint32 spriteFileID);
+	void saveSpriteIndexFile(const Common::String &filename, uint32 spriteFileID);
+
+	struct TransformKey {
+		uint32 _spriteId;
+		SpriteTransform _transform;
+
+		bool operator==(const TransformKey &other) const {
+			return _spriteId == other._spriteId && _transform == other._transform;
+		}
+	};
+
+	struct TransformKeyHash {
+		uint operator()(const TransformKey &key) const;
+	};
+
+	struct TransformedSprite {
+		Graphics::Surface *_surface;
+		uint32 _lastUsed;
+	};
+
+	Common::HashMap<TransformKey, TransformedSprite, TransformKeyHash> _transformCache;
+	uint32 _transformCacheSize;
 };
 
 } // End of namespace AGS